@@ -0,0 +1,297 @@
+#include <thread>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <random>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <cassert>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+#include <tbb/concurrent_vector.h>
+
+#include "LockfreeVector8.h"
+#include "LockfreeVector9.h"
+#include "LockfreeVector10.h"
+#include "LockfreeMap2.h"
+#include "LockfreeMap3.h"
+#include "LockfreeHashMap.h"
+
+/**
+ * Benchmark of the vectors and maps against a mutex-protected std::vector and tbb::concurrent_vector
+ *
+ * Workloads (elements are the thread number, maps spread them over KEYS keys):
+ *   push   every thread pushes ops elements
+ *   read   the structure is filled with ops elements, every thread iterates over all of them
+ *   mixed  half of the threads push ops elements, the others iterate until the pushes are done
+ *   skewed every thread pushes ops elements to keys drawn from a Zipf distribution (maps only)
+ * Structures are built and filled before the clock starts, threads start together after warmup runs.
+ * Reported are operations (pushed or visited elements) per second and thread over the repetitions.
+ * */
+
+static constexpr unsigned int KEYS = 1024;
+
+typedef LockfreeVector8<uint32_t, 1000> vec8;
+typedef LockfreeVector9<uint32_t, 1000, 0, 16> vec9;
+typedef LockfreeVector9<uint32_t, 1024, 0, 16, 0, 16> vec9g;
+typedef LockfreeVector10<uint32_t, 1000, 16> vec10;
+typedef LockfreeMap2<uint32_t, 1000, 0, 16> map2;
+typedef LockfreeMap3<uint32_t, 1000, 0, 16> map3;
+typedef LockfreeHashMap<uint32_t, 1000, 0, 16> hashmap;
+typedef tbb::concurrent_vector<uint32_t> tbbvec;
+
+struct mutexvec {
+    std::mutex mutex;
+    std::vector<uint32_t> values;
+};
+
+struct mutexmap {
+    std::vector<std::mutex> mutexes;
+    std::vector<std::vector<uint32_t>> lists;
+    mutexmap() : mutexes(KEYS), lists(KEYS) { }
+};
+
+struct tbbmap {
+    std::vector<tbbvec> lists;
+    tbbmap() : lists(KEYS) { }
+};
+
+// adapters, maps take key % KEYS
+template<class T> T* make() { return new T(); }
+template<> map2* make<map2>() { return new map2(KEYS); }
+template<> map3* make<map3>() { return new map3(KEYS); }
+template<> hashmap* make<hashmap>() { return new hashmap(KEYS); }
+
+template<class T> void push(T& s, uint32_t, uint32_t value) { s.push(value); }
+template<> void push<tbbvec>(tbbvec& s, uint32_t, uint32_t value) { s.push_back(value); }
+template<> void push<mutexvec>(mutexvec& s, uint32_t, uint32_t value) {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.values.push_back(value);
+}
+template<> void push<map2>(map2& s, uint32_t key, uint32_t value) { s.push(key, value); }
+template<> void push<map3>(map3& s, uint32_t key, uint32_t value) { s.push(key, value); }
+template<> void push<hashmap>(hashmap& s, uint32_t key, uint32_t value) { s.push(key * 0x9E3779B97F4A7C15ull, value); }
+template<> void push<tbbmap>(tbbmap& s, uint32_t key, uint32_t value) { s.lists[key].push_back(value); }
+template<> void push<mutexmap>(mutexmap& s, uint32_t key, uint32_t value) {
+    std::lock_guard<std::mutex> lock(s.mutexes[key]);
+    s.lists[key].push_back(value);
+}
+
+// number of visited elements, the sum keeps the loop from being optimized away
+template<class T> size_t read(T& s, uint64_t& sum) {
+    size_t n = 0;
+    for (uint32_t value : s) { sum += value; n++; }
+    return n;
+}
+template<> size_t read<mutexvec>(mutexvec& s, uint64_t& sum) {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    for (uint32_t value : s.values) sum += value;
+    return s.values.size();
+}
+template<> size_t read<map2>(map2& s, uint64_t& sum) {
+    size_t n = 0;
+    for (unsigned int key = 0; key < s.size(); key++) for (uint32_t value : s[key]) { sum += value; n++; }
+    return n;
+}
+template<> size_t read<map3>(map3& s, uint64_t& sum) {
+    size_t n = 0;
+    for (unsigned int key = 0; key < s.size(); key++) for (uint32_t value : s[key]) { sum += value; n++; }
+    return n;
+}
+template<> size_t read<hashmap>(hashmap& s, uint64_t& sum) {
+    size_t n = 0;
+    for (unsigned int id = 0; id < s.size(); id++) for (uint32_t value : s.at(id)) { sum += value; n++; }
+    return n;
+}
+template<> size_t read<tbbmap>(tbbmap& s, uint64_t& sum) {
+    size_t n = 0;
+    for (tbbvec& list : s.lists) for (uint32_t value : list) { sum += value; n++; }
+    return n;
+}
+template<> size_t read<mutexmap>(mutexmap& s, uint64_t& sum) {
+    size_t n = 0;
+    for (unsigned int key = 0; key < KEYS; key++) {
+        std::lock_guard<std::mutex> lock(s.mutexes[key]);
+        for (uint32_t value : s.lists[key]) sum += value;
+        n += s.lists[key].size();
+    }
+    return n;
+}
+
+// keys drawn from a Zipf distribution with exponent 1 by inversion of its cumulative distribution
+std::vector<uint32_t> zipf_keys(size_t n, unsigned int seed) {
+    std::vector<double> cdf(KEYS);
+    double sum = 0;
+    for (unsigned int k = 0; k < KEYS; k++) cdf[k] = (sum += 1.0 / (k + 1));
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0, sum);
+    std::vector<uint32_t> keys(n);
+    for (size_t i = 0; i < n; i++) keys[i] = std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+    return keys;
+}
+
+// seconds for one run of workload, counts the operations of all threads into ops
+template<class T>
+double run(const std::string& workload, unsigned int threads, size_t n, size_t& ops) {
+    T* s = make<T>();
+    std::vector<std::vector<uint32_t>> keys(threads);
+    for (unsigned int t = 0; t < threads; t++) {
+        if (workload == "skewed") keys[t] = zipf_keys(n, t + 1);
+        else for (size_t i = 0; i < n; i++) keys[t].push_back((i * threads + t) % KEYS);
+    }
+    if (workload == "read") for (size_t i = 0; i < n; i++) push<T>(*s, i % KEYS, 1 + i % threads);
+
+    std::atomic<unsigned int> ready(0);
+    std::atomic<bool> start(false);
+    std::atomic<unsigned int> writing(0);
+    std::atomic<size_t> total(0);
+    std::atomic<uint64_t> checksum(0);
+    unsigned int writers = workload == "read" ? 0 : workload == "mixed" ? std::max(1u, threads / 2) : threads;
+    writing = writers;
+
+    std::vector<std::thread> pool { };
+    for (unsigned int t = 0; t < threads; t++) {
+        pool.push_back(std::thread([&, t] {
+            ready++;
+            while (!start.load(std::memory_order_acquire)) { }
+            uint64_t sum = 0;
+            size_t count = 0;
+            if (t < writers) {
+                for (size_t i = 0; i < n; i++) push<T>(*s, keys[t][i], t + 1);
+                count = n;
+                writing--;
+            }
+            else if (workload == "read") {
+                count = read<T>(*s, sum);
+            }
+            else do {
+                count += read<T>(*s, sum);
+            } while (writing.load() > 0);
+            total += count;
+            checksum += sum;
+        }));
+    }
+    while (ready.load() < threads) { }
+    auto begin = std::chrono::steady_clock::now();
+    start.store(true, std::memory_order_release);
+    for (std::thread& thread : pool) thread.join();
+    auto end = std::chrono::steady_clock::now();
+    ops = total.load();
+    delete s;
+    return std::chrono::duration<double>(end - begin).count();
+}
+
+struct Result {
+    std::string structure, workload;
+    unsigned int threads;
+    size_t n;
+    std::vector<double> rates; // operations per second and thread
+};
+
+template<class T>
+bool bench(const std::string& structure, const std::string& workload, unsigned int threads, size_t n,
+        unsigned int warmup, unsigned int reps, Result& result) {
+    result = Result { structure, workload, threads, n, { } };
+    size_t ops = 0;
+    for (unsigned int r = 0; r < warmup; r++) run<T>(workload, threads, n, ops);
+    for (unsigned int r = 0; r < reps; r++) {
+        double seconds = run<T>(workload, threads, n, ops);
+        result.rates.push_back(ops / seconds / threads);
+    }
+    return true;
+}
+
+bool bench(const std::string& structure, const std::string& workload, unsigned int threads, size_t n,
+        unsigned int warmup, unsigned int reps, Result& result) {
+    bool map = structure == "map2" || structure == "map3" || structure == "hashmap" || structure == "tbbmap" || structure == "mutexmap";
+    if (workload == "skewed" && !map) return false;
+    if (workload != "push" && workload != "read" && workload != "mixed" && workload != "skewed") return false;
+    if (structure == "vec8") return bench<vec8>(structure, workload, threads, n, warmup, reps, result);
+    if (structure == "vec9") return bench<vec9>(structure, workload, threads, n, warmup, reps, result);
+    if (structure == "vec9g") return bench<vec9g>(structure, workload, threads, n, warmup, reps, result);
+    if (structure == "vec10") return bench<vec10>(structure, workload, threads, n, warmup, reps, result);
+    if (structure == "tbb") return bench<tbbvec>(structure, workload, threads, n, warmup, reps, result);
+    if (structure == "mutex") return bench<mutexvec>(structure, workload, threads, n, warmup, reps, result);
+    if (structure == "map2") return bench<map2>(structure, workload, threads, n, warmup, reps, result);
+    if (structure == "map3") return bench<map3>(structure, workload, threads, n, warmup, reps, result);
+    if (structure == "hashmap") return bench<hashmap>(structure, workload, threads, n, warmup, reps, result);
+    if (structure == "tbbmap") return bench<tbbmap>(structure, workload, threads, n, warmup, reps, result);
+    if (structure == "mutexmap") return bench<mutexmap>(structure, workload, threads, n, warmup, reps, result);
+    return false;
+}
+
+std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items { };
+    std::stringstream stream(list);
+    for (std::string item; std::getline(stream, item, ','); ) if (!item.empty()) items.push_back(item);
+    return items;
+}
+
+void print(const Result& result, bool json, bool first) {
+    double mean = std::accumulate(result.rates.begin(), result.rates.end(), 0.0) / result.rates.size();
+    double var = 0;
+    for (double rate : result.rates) var += (rate - mean) * (rate - mean);
+    double stddev = result.rates.size() > 1 ? std::sqrt(var / (result.rates.size() - 1)) : 0;
+    double min = *std::min_element(result.rates.begin(), result.rates.end());
+    double max = *std::max_element(result.rates.begin(), result.rates.end());
+    if (json) {
+        std::cout << (first ? "[\n" : ",\n") << "  { \"structure\": \"" << result.structure << "\", \"workload\": \"" << result.workload
+            << "\", \"threads\": " << result.threads << ", \"ops\": " << result.n << ", \"reps\": " << result.rates.size()
+            << ", \"ops_per_thread_s\": " << mean << ", \"stddev\": " << stddev << ", \"min\": " << min << ", \"max\": " << max << " }";
+    }
+    else {
+        if (first) std::cout << "structure,workload,threads,ops,reps,ops_per_thread_s,stddev,min,max" << std::endl;
+        std::cout << result.structure << "," << result.workload << "," << result.threads << "," << result.n << "," << result.rates.size()
+            << "," << mean << "," << stddev << "," << min << "," << max << std::endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string structures = "vec8,vec9,vec9g,vec10,tbb,mutex,map2,map3,hashmap,tbbmap,mutexmap";
+    std::string workloads = "push,read,mixed,skewed";
+    std::string threads = std::to_string(std::max(1u, std::thread::hardware_concurrency()));
+    size_t n = 1000000;
+    unsigned int warmup = 1, reps = 5;
+    bool json = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        std::string value = i + 1 < argc ? argv[i + 1] : "";
+        if (arg == "--structures") { structures = value; i++; }
+        else if (arg == "--workloads") { workloads = value; i++; }
+        else if (arg == "--threads") { threads = value; i++; }
+        else if (arg == "--ops") { n = std::stoull(value); i++; }
+        else if (arg == "--warmup") { warmup = std::stoul(value); i++; }
+        else if (arg == "--reps") { reps = std::max(1ul, std::stoul(value)); i++; }
+        else if (arg == "--json") json = true;
+        else {
+            std::cout << "Usage: " << argv[0] << " [--structures " << structures << "] [--workloads " << workloads << "]" << std::endl
+                << "    [--threads 1,2,4,...] [--ops elements per thread] [--warmup runs] [--reps runs] [--json]" << std::endl;
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    bool first = true;
+    for (const std::string& structure : split(structures)) {
+        for (const std::string& workload : split(workloads)) {
+            for (const std::string& t : split(threads)) {
+                Result result;
+                if (!bench(structure, workload, std::max(1ul, std::stoul(t)), n, warmup, reps, result)) {
+                    if (workload != "skewed") std::cerr << "Skipping " << structure << " " << workload << std::endl;
+                    continue;
+                }
+                print(result, json, first);
+                first = false;
+            }
+        }
+    }
+    if (json) std::cout << (first ? "[]" : "\n]") << std::endl;
+#ifdef LOCKFREE_LATENCY
+    LockfreeLatency::report(std::cerr); // keep stdout machine readable
+#endif
+    return 0;
+}
@@ -0,0 +1,254 @@
+/*************************************************************************************************
+LockfreeEpoch -- Copyright (c) 2020, Markus Iser, KIT - Karlsruhe Institute of Technology
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **************************************************************************************************/
+
+#ifndef Lockfree_Epoch
+#define Lockfree_Epoch
+
+#include <cstdlib>
+#include <atomic>
+#include <array>
+#include <vector>
+
+#include "LockfreeLatency.h"
+
+/**
+ * Epoch-based memory reclamation domain
+ * 
+ * Readers register a reader record (acquire()), announce the global epoch on enter() and withdraw 
+ * it on leave(). Records are handed out dynamically and recycled after release(), the last released 
+ * record is tried first. A thread can hold any number of them, e.g., one per iterator (see guard), 
+ * the registry never grows beyond the peak number of records held at the same time, which bounds 
+ * the walk of try_advance().
+ * Writers retire() memory instead of freeing it. The epoch advances once all active readers 
+ * announced the current epoch, memory retired in epoch e is freed once the epoch reached e+2.
+ * Memory can be retired with a custom reclaim function, which can decline (return false) 
+ * to be called again on a later collection.
+ * Collection is opportunistic and amortised: each thread collects on every COLLECT-th retire or 
+ * leave while memory is pending, writers never wait for readers. Nodes of reclaimed memory are 
+ * cached per thread for the next retire.
+ * */
+class LockfreeEpoch {
+public:
+    struct alignas(64) Reader {
+        std::atomic<uint64_t> epoch; // 0 if not reading
+        std::atomic<bool> used; // registered
+        Reader* next;
+    };
+
+    /**
+     * RAII reader registration, the domain is entered for the lifetime of the guard
+     * */
+    class guard {
+        LockfreeEpoch* domain;
+        Reader* reader;
+
+        guard(guard const&) = delete;
+        void operator=(guard const&) = delete;
+
+    public:
+        guard(LockfreeEpoch& domain_) : domain(&domain_), reader(domain_.acquire()) { 
+            domain->enter(reader);
+        }
+
+        guard(guard&& other) : domain(other.domain), reader(other.reader) { 
+            other.reader = nullptr;
+        }
+
+        ~guard() {
+            if (reader != nullptr) {
+                domain->leave(reader);
+                domain->release(reader);
+            }
+        }
+    };
+
+private:
+    struct Retired {
+        void* ptr;
+        bool (*reclaim)(void*); // nullptr: free(ptr)
+        uint64_t epoch;
+        Retired* next;
+    };
+
+    static constexpr unsigned int COLLECT = 8; // retires or leaves of a thread per collection
+    static constexpr size_t SPARES = 64; // cached nodes per thread
+
+    static inline bool reclaim(Retired* node) {
+        if (node->reclaim != nullptr) return node->reclaim(node->ptr);
+        free(node->ptr);
+        return true;
+    }
+
+    // node cache of the calling thread, nullptr once it is destroyed (domains of static duration drain later)
+    static inline std::vector<Retired*>* spares() {
+        static thread_local bool gone = false;
+        if (gone) return nullptr;
+        static thread_local struct Spares {
+            std::vector<Retired*> nodes;
+            ~Spares() { for (Retired* node : nodes) delete node; gone = true; }
+        } spares { };
+        return &spares.nodes;
+    }
+
+    static inline Retired* make_node(void* ptr, bool (*reclaim)(void*), uint64_t e) {
+        std::vector<Retired*>* nodes = spares();
+        if (nodes == nullptr || nodes->empty()) return new Retired { ptr, reclaim, e, nullptr };
+        Retired* node = nodes->back();
+        nodes->pop_back();
+        *node = { ptr, reclaim, e, nullptr };
+        return node;
+    }
+
+    static inline void drop_node(Retired* node) {
+        std::vector<Retired*>* nodes = spares();
+        if (nodes != nullptr && nodes->size() < SPARES) nodes->push_back(node);
+        else delete node;
+    }
+
+    // true on every COLLECT-th call of a thread
+    static inline bool due() {
+        static thread_local unsigned int ticks = 0;
+        return ++ticks % COLLECT == 0;
+    }
+
+    alignas(64) std::atomic<uint64_t> epoch;
+    std::atomic<Retired*> retired;
+    std::atomic<Reader*> readers; // registry, records are recycled but never unlinked
+    std::atomic<Reader*> spare; // last released record
+
+    bool try_advance() {
+        LOCKFREE_LATENCY_SCOPE(RECLAIM_WAIT);
+        uint64_t e = epoch.load(std::memory_order_seq_cst);
+        for (Reader* reader = readers.load(std::memory_order_acquire); reader != nullptr; reader = reader->next) {
+            if (!reader->used.load(std::memory_order_relaxed)) continue; // only live records
+            uint64_t r = reader->epoch.load(std::memory_order_seq_cst);
+            if (r != 0 && r != e) return false;
+        }
+        return epoch.compare_exchange_strong(e, e + 1, std::memory_order_acq_rel);
+    }
+
+    void requeue(Retired* first, Retired* last) {
+        Retired* head = retired.load(std::memory_order_relaxed);
+        do {
+            last->next = head;
+        } while (!retired.compare_exchange_weak(head, first, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    LockfreeEpoch(LockfreeEpoch const&) = delete;
+    void operator=(LockfreeEpoch const&) = delete;
+    LockfreeEpoch(LockfreeEpoch&& other) = delete;
+
+public:
+    LockfreeEpoch() : epoch(1), retired(nullptr), readers(nullptr), spare(nullptr) { }
+
+    ~LockfreeEpoch() {
+        drain();
+        Reader* reader = readers.load(std::memory_order_acquire);
+        while (reader != nullptr) {
+            Reader* next = reader->next;
+            delete reader;
+            reader = next;
+        }
+    }
+
+    // register a reader record, reuses released records
+    Reader* acquire() {
+        Reader* last = spare.load(std::memory_order_relaxed);
+        bool unused = false;
+        if (last != nullptr && !last->used.load(std::memory_order_relaxed) 
+                && last->used.compare_exchange_strong(unused, true, std::memory_order_acquire)) {
+            return last;
+        }
+        for (Reader* reader = readers.load(std::memory_order_acquire); reader != nullptr; reader = reader->next) {
+            bool used = false;
+            if (!reader->used.load(std::memory_order_relaxed) 
+                    && reader->used.compare_exchange_strong(used, true, std::memory_order_acquire)) {
+                return reader;
+            }
+        }
+        Reader* reader = new Reader();
+        reader->epoch.store(0, std::memory_order_relaxed);
+        reader->used.store(true, std::memory_order_relaxed);
+        reader->next = readers.load(std::memory_order_relaxed);
+        while (!readers.compare_exchange_weak(reader->next, reader, std::memory_order_release, std::memory_order_relaxed)) { }
+        return reader;
+    }
+
+    inline void release(Reader* reader) {
+        reader->used.store(false, std::memory_order_release);
+        spare.store(reader, std::memory_order_relaxed);
+    }
+
+    inline void enter(Reader* reader) {
+        reader->epoch.store(epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst); // announce before reading shared pointers
+    }
+
+    inline void leave(Reader* reader) {
+        reader->epoch.store(0, std::memory_order_release);
+        if (retired.load(std::memory_order_relaxed) != nullptr && due()) collect();
+    }
+
+    // ptr must not be reachable for readers that enter from now on
+    void retire(void* ptr, bool (*reclaim)(void*) = nullptr) {
+        std::atomic_thread_fence(std::memory_order_seq_cst); // unlink before reading the epoch
+        Retired* node = make_node(ptr, reclaim, epoch.load(std::memory_order_relaxed));
+        requeue(node, node);
+        if (due()) collect();
+    }
+
+    void collect() {
+        try_advance();
+        uint64_t e = epoch.load(std::memory_order_acquire);
+        Retired* node = retired.exchange(nullptr, std::memory_order_acquire);
+        Retired* first = nullptr;
+        Retired* last = nullptr;
+        while (node != nullptr) {
+            Retired* next = node->next;
+            if (node->epoch + 2 <= e && reclaim(node)) {
+                drop_node(node);
+            }
+            else { // keep
+                node->next = first;
+                first = node;
+                if (last == nullptr) last = node;
+            }
+            node = next;
+        }
+        if (first != nullptr) requeue(first, last);
+    }
+
+    /**
+     * Reclaim everything regardless of epochs, expects that there are no readers and writers left.
+     * Reclaim functions that decline are called again until they accept (busy-loop), 
+     * e.g., while a late writer commits a slot it claimed.
+     * */
+    void drain() {
+        Retired* node = retired.exchange(nullptr, std::memory_order_acquire);
+        while (node != nullptr) {
+            Retired* next = node->next;
+            while (!reclaim(node)) { }
+            drop_node(node);
+            node = next;
+        }
+    }
+
+};
+
+#endif
@@ -0,0 +1,198 @@
+/*************************************************************************************************
+LockfreeHashMap -- Copyright (c) 2020, Markus Iser, KIT - Karlsruhe Institute of Technology
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **************************************************************************************************/
+
+#ifndef Lockfree_HashMap
+#define Lockfree_HashMap
+
+#include <cassert>
+#include <cstdlib>
+#include <cstdint>
+#include <atomic>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <algorithm>
+
+#include "LockfreeMap3.h"
+
+/**
+ * Multimap from sparse 64-bit keys to the page chains of a LockfreeMap3
+ * T is the content type and must be integral
+ * N elements per page
+ * S sentinel element
+ * B counter bits, assert B <= 16, N < 2^B
+ * E empty key, must not be inserted
+ * 
+ * Keys are translated to dense ids by a lock-free open-addressing table. A key is claimed by CAS 
+ * within a window of W slots of its hash, the id is drawn from a counter afterwards. Once a window is 
+ * full the key goes to the next table, which has twice the slots. Tables are allocated on first use 
+ * and keys never move, so a lookup probes one window per table and ids stay valid while the map grows.
+ * */
+template<typename T = uint32_t, unsigned int N = 1000, T S = 0, unsigned int B = 16, uint64_t E = UINT64_MAX>
+class LockfreeHashMap {
+public:
+    typedef LockfreeMap3<T, N, S, B> Map;
+    typedef typename std::remove_reference<decltype(std::declval<Map>()[0])>::type Vector;
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> key;
+        std::atomic<unsigned int> id; // id + 1, 0 until published
+    };
+
+    static constexpr unsigned int TABLES = 32;
+    static constexpr unsigned int W = 64; // probe window
+
+    std::atomic<Slot*> tables[TABLES];
+    const unsigned int C; // slots in the first table
+    std::atomic<unsigned int> ids;
+    Map map;
+
+    LockfreeHashMap(LockfreeHashMap const&) = delete;
+    void operator=(LockfreeHashMap const&) = delete;
+    LockfreeHashMap(LockfreeHashMap&& other) = delete;
+
+    static inline uint64_t hash(uint64_t key) { // splitmix64 finalizer
+        key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ull;
+        key = (key ^ (key >> 27)) * 0x94d049bb133111ebull;
+        return key ^ (key >> 31);
+    }
+
+    inline size_t slots(unsigned int t) const {
+        return (size_t)C << t;
+    }
+
+    Slot* table(unsigned int t, bool create) {
+        Slot* tab = tables[t].load(std::memory_order_acquire);
+        if (tab == nullptr && create) { // concurrent allocations of the same table are resolved by CAS
+            Slot* fresh = (Slot*)std::malloc(slots(t) * sizeof(Slot));
+            for (size_t i = 0; i < slots(t); i++) {
+                new (&fresh[i].key) std::atomic<uint64_t>(E);
+                new (&fresh[i].id) std::atomic<unsigned int>(0);
+            }
+            if (tables[t].compare_exchange_strong(tab, fresh, std::memory_order_acq_rel)) tab = fresh;
+            else free(fresh);
+        }
+        return tab;
+    }
+
+    inline unsigned int wait_id(Slot& slot) {
+        unsigned int id;
+        while ((id = slot.id.load(std::memory_order_acquire)) == 0) { // busy-loop until the inserter published it
+            map.statistics().add(LockfreeStats::SPINS);
+        }
+        return id - 1;
+    }
+
+    /**
+     * Id of key, or ~0u if it is not present and insert is false
+     * Inserts of the same key follow the same probe sequence and meet in the same slot, 
+     * slots are never emptied, so the first empty slot of a window ends the search.
+     * */
+    unsigned int lookup(uint64_t key, bool insert) {
+        assert(key != E);
+        uint64_t h = hash(key);
+        for (unsigned int t = 0; t < TABLES; t++) {
+            Slot* tab = table(t, insert);
+            if (tab == nullptr) return ~0u;
+            size_t mask = slots(t) - 1;
+            unsigned int window = (unsigned int)std::min<size_t>(W, slots(t));
+            for (unsigned int j = 0; j < window; j++) {
+                Slot& slot = tab[(h + j) & mask];
+                uint64_t k = slot.key.load(std::memory_order_acquire);
+                if (k == E) {
+                    if (!insert) return ~0u;
+                    if (slot.key.compare_exchange_strong(k, key, std::memory_order_acq_rel)) {
+                        unsigned int id = ids.fetch_add(1, std::memory_order_relaxed);
+                        map.reserve(id + 1);
+                        slot.id.store(id + 1, std::memory_order_release);
+                        return id;
+                    }
+                    map.statistics().add(LockfreeStats::CAS_FAILURES);
+                }
+                if (k == key) return wait_id(slot);
+            }
+        }
+        assert(false);
+        return ~0u;
+    }
+
+public:
+    // c slots in the first table, rounded up to a power of two
+    LockfreeHashMap(unsigned int c = 1024) : C(1u << (32 - __builtin_clz(std::max(c, 2u) - 1))), ids(0), map(c) {
+        for (unsigned int t = 0; t < TABLES; t++) tables[t].store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~LockfreeHashMap() {
+        for (unsigned int t = 0; t < TABLES; t++) free(tables[t].load(std::memory_order_relaxed));
+    }
+
+    // number of keys, their ids are 0 to size() - 1
+    unsigned int size() const {
+        return std::min(ids.load(std::memory_order_acquire), map.size());
+    }
+
+    // insert-or-get the list of key
+    inline Vector& operator [] (uint64_t key) {
+        return map[lookup(key, true)];
+    }
+
+    // list of key, or nullptr if key is not present
+    inline Vector* find(uint64_t key) {
+        unsigned int id = lookup(key, false);
+        return id == ~0u ? nullptr : &map[id];
+    }
+
+    // list of the key with the given id, expects id < size()
+    inline Vector& at(unsigned int id) {
+        return map[id];
+    }
+
+    inline unsigned int id(uint64_t key) {
+        return lookup(key, true);
+    }
+
+    void push(uint64_t key, T value) {
+        map.push(lookup(key, true), value);
+    }
+
+    template<typename Iterator>
+    void push(uint64_t key, Iterator first, Iterator last) {
+        map.push(lookup(key, true), first, last);
+    }
+
+    // contention and retry counters of the key table and the lists (see LockfreeStats)
+    inline LockfreeStats& statistics() const {
+        return map.statistics();
+    }
+
+    // readers that may run concurrently with clear() hold a guard while iterating
+    inline LockfreeEpoch::guard protect() {
+        return map.protect();
+    }
+
+    // empty the list of key, the key keeps its id
+    void clear(uint64_t key) {
+        unsigned int id = lookup(key, false);
+        if (id != ~0u) map.clear(id);
+    }
+
+};
+
+#endif
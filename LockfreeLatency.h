@@ -0,0 +1,180 @@
+/*************************************************************************************************
+LockfreeLatency -- Copyright (c) 2020, Markus Iser, KIT - Karlsruhe Institute of Technology
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **************************************************************************************************/
+
+#ifndef Lockfree_Latency
+#define Lockfree_Latency
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <algorithm>
+
+/**
+ * Latency histograms of pushes, iterator creation, page allocations and reclamation waits
+ * 
+ * Compiled in with -DLOCKFREE_LATENCY, otherwise LOCKFREE_LATENCY_SCOPE(event) expands to nothing.
+ * A scope records the nanoseconds until it is left to the histogram of its thread, which is registered 
+ * on first use. A histogram (about 23 KB) is kept with its counts after its thread exits and handed to 
+ * the next thread that registers, so memory is bounded by the peak number of recording threads. 
+ * RECLAIM_WAIT covers the reader scan of an epoch advance and the reclaim functions of the maps. 
+ * Buckets are log-linear (HDR style): values below 2^SUB have their own bucket, above that every 
+ * power of two is split into 2^SUB buckets, which bounds the relative error of reported percentiles 
+ * by 2^-SUB. Counters are written by their thread only, 
+ * summary() and report() merge the histograms of all threads at any time.
+ * */
+class LockfreeLatency {
+public:
+    enum Event { PUSH, BEGIN, PAGE_ALLOC, GROW, RECLAIM_WAIT, EVENTS };
+
+    struct Summary {
+        uint64_t count;
+        uint64_t p50, p90, p99, p999, max; // nanoseconds, lower bounds of the buckets
+    };
+
+private:
+    static constexpr unsigned int SUB = 4;
+    static constexpr unsigned int RANGE = 40; // values from 2^40 ns (about 18 minutes) on share the last bucket
+    static constexpr unsigned int BUCKETS = (RANGE - SUB + 1) << SUB;
+
+    struct Histogram {
+        std::atomic<uint64_t> counts[EVENTS][BUCKETS];
+        std::atomic<uint64_t> max[EVENTS];
+        std::atomic<bool> used; // owned by a running thread
+        Histogram* next;
+    };
+
+    // returns the histogram of the thread to the pool when the thread exits
+    struct Owner {
+        Histogram* histogram;
+        ~Owner() { if (histogram != nullptr) histogram->used.store(false, std::memory_order_release); }
+    };
+
+    static inline std::atomic<Histogram*> histograms { nullptr };
+    static inline thread_local Owner local { nullptr };
+
+    static inline unsigned int bucket(uint64_t ns) {
+        if (ns < (1ull << SUB)) return (unsigned int)ns;
+        unsigned int m = 63 - __builtin_clzll(ns);
+        if (m >= RANGE) return BUCKETS - 1;
+        return ((m - SUB + 1) << SUB) + (unsigned int)((ns >> (m - SUB)) & ((1u << SUB) - 1));
+    }
+
+    // smallest value of bucket b
+    static inline uint64_t lower(unsigned int b) {
+        if (b < (1u << SUB)) return b;
+        unsigned int m = (b >> SUB) + SUB - 1;
+        return ((1ull << SUB) + (b & ((1u << SUB) - 1))) << (m - SUB);
+    }
+
+    // histogram of the calling thread, prefers one left by an exited thread
+    static Histogram& histogram() {
+        if (local.histogram == nullptr) {
+            for (Histogram* h = histograms.load(std::memory_order_acquire); h != nullptr; h = h->next) {
+                bool used = false;
+                if (!h->used.load(std::memory_order_relaxed) && h->used.compare_exchange_strong(used, true, std::memory_order_acquire)) {
+                    local.histogram = h;
+                    return *h;
+                }
+            }
+            Histogram* h = new Histogram();
+            for (unsigned int e = 0; e < EVENTS; e++) {
+                for (unsigned int b = 0; b < BUCKETS; b++) h->counts[e][b].store(0, std::memory_order_relaxed);
+                h->max[e].store(0, std::memory_order_relaxed);
+            }
+            h->used.store(true, std::memory_order_relaxed);
+            h->next = histograms.load(std::memory_order_relaxed);
+            while (!histograms.compare_exchange_weak(h->next, h, std::memory_order_release, std::memory_order_relaxed)) { }
+            local.histogram = h;
+        }
+        return *local.histogram;
+    }
+
+public:
+    static constexpr const char* names[EVENTS] = { "push", "begin", "page_alloc", "grow", "reclaim_wait" };
+
+    // measures the lifetime of the scope
+    class Scope {
+        Event event;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        Scope(Event event_) : event(event_), start(std::chrono::steady_clock::now()) { }
+
+        ~Scope() {
+            record(event, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        }
+    };
+
+    static void record(Event event, uint64_t ns) {
+        Histogram& h = histogram();
+        std::atomic<uint64_t>& count = h.counts[event][bucket(ns)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); // single writer
+        if (ns > h.max[event].load(std::memory_order_relaxed)) h.max[event].store(ns, std::memory_order_relaxed);
+    }
+
+    // percentiles of event over all threads
+    static Summary summary(Event event) {
+        uint64_t merged[BUCKETS] = { };
+        Summary s { 0, 0, 0, 0, 0, 0 };
+        for (Histogram* h = histograms.load(std::memory_order_acquire); h != nullptr; h = h->next) {
+            for (unsigned int b = 0; b < BUCKETS; b++) merged[b] += h->counts[event][b].load(std::memory_order_relaxed);
+            s.max = std::max(s.max, h->max[event].load(std::memory_order_relaxed));
+        }
+        for (unsigned int b = 0; b < BUCKETS; b++) s.count += merged[b];
+        uint64_t* quantiles[4] = { &s.p50, &s.p90, &s.p99, &s.p999 };
+        const double fractions[4] = { 0.5, 0.9, 0.99, 0.999 };
+        uint64_t seen = 0;
+        unsigned int q = 0;
+        for (unsigned int b = 0; b < BUCKETS && q < 4; b++) {
+            seen += merged[b];
+            while (q < 4 && s.count > 0 && seen >= fractions[q] * s.count) *quantiles[q++] = lower(b);
+        }
+        return s;
+    }
+
+    // one CSV line per recorded event
+    static void report(std::ostream& out) {
+        out << "event,count,p50_ns,p90_ns,p99_ns,p999_ns,max_ns" << std::endl;
+        for (unsigned int e = 0; e < EVENTS; e++) {
+            Summary s = summary((Event)e);
+            if (s.count == 0) continue;
+            out << names[e] << "," << s.count << "," << s.p50 << "," << s.p90 << "," << s.p99 << "," << s.p999 << "," << s.max << std::endl;
+        }
+    }
+
+    // counters of threads that record concurrently might survive
+    static void reset() {
+        for (Histogram* h = histograms.load(std::memory_order_acquire); h != nullptr; h = h->next) {
+            for (unsigned int e = 0; e < EVENTS; e++) {
+                for (unsigned int b = 0; b < BUCKETS; b++) h->counts[e][b].store(0, std::memory_order_relaxed);
+                h->max[e].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+};
+
+#ifdef LOCKFREE_LATENCY
+#define LOCKFREE_LATENCY_SCOPE(event) LockfreeLatency::Scope lockfree_latency_##event(LockfreeLatency::event)
+#else
+#define LOCKFREE_LATENCY_SCOPE(event)
+#endif
+
+#endif
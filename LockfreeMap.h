@@ -26,22 +26,25 @@ OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWA
 #include <mutex>
 #include <memory>
 
+#include "LockfreeEpoch.h"
+
 /**
  * T is the content type and must be integral
  * S is the sentinel element and must not occur in input
- * C maximal number of available hazards
+ * Outgrown memory is retired to an epoch-based reclamation domain, push never waits for readers
+ * Every iterator registers its own reader record, a thread can hold several iterators at once
  * */
-template<typename T = uint32_t, int S = 0, unsigned int C = 8>
+template<typename T = uint32_t, int S = 0>
 class LockfreeMap {
 public:
     class const_iterator {
+        LockfreeEpoch::guard guard; // initialized first: enter the domain before reading memory
         T* pos;
-        T** hazard;
 
     public:
-        const_iterator(T** mem) : pos(*mem), hazard(mem) { }
+        const_iterator(LockfreeEpoch& domain, T* const& mem) : guard(domain), pos(mem) { }
 
-        ~const_iterator() { *hazard = nullptr; }
+        ~const_iterator() { }
 
         inline const T operator * () const { return *pos; }
 
@@ -94,42 +97,22 @@ private:
                 } 
             }
         }
-
-        inline const_iterator iter(T*& hazard) {
-            while (hazard != memory) {
-                hazard = memory;
-                std::atomic_thread_fence(std::memory_order_acq_rel);
-            }
-            return const_iterator(&hazard);
-        }
     };
 
     LockfreeVector* map; 
     const unsigned int size_;
-    std::array<T*, C> hazards;
-
-    void safe_free(T* mem) {
-        std::atomic_thread_fence(std::memory_order_acquire);
-        for (bool safe = false; !safe; ) {
-            safe = true;
-            for (T* p : hazards) {
-                safe &= (p != mem);
-            }
-        }
-        free(mem);
-    }
+    LockfreeEpoch domain;
 
     LockfreeMap(LockfreeMap const&) = delete;
     void operator=(LockfreeMap const&) = delete;
     LockfreeMap(LockfreeMap&& other) = delete;
 
 public:
-    LockfreeMap(unsigned int m, unsigned int n) : hazards(), size_(m) {
+    LockfreeMap(unsigned int m, unsigned int n) : size_(m), domain() {
         map = (LockfreeVector*)std::calloc(size_, sizeof(LockfreeVector));
         for (unsigned int i = 0; i < size_; i++) {
             new ((void*)(&map[i])) LockfreeVector(n);
         }
-        hazards.fill(nullptr);
     }
 
     ~LockfreeMap() { 
@@ -143,12 +126,11 @@ public:
 
     void push(T key, T value) {
         T* ptr = map[key].push(value);
-        if (ptr != nullptr) safe_free(ptr);
+        if (ptr != nullptr) domain.retire(ptr);
     }
 
-    inline const_iterator iter(T key, unsigned int thread_id) {
-        assert(hazards[thread_id] == nullptr); // at most one iterator per thread-id
-        return map[key].iter(hazards[thread_id]);
+    inline const_iterator iter(T key) {
+        return const_iterator(domain, map[key].memory);
     }
 
 };
@@ -25,42 +25,116 @@ OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWA
 #include <atomic>
 #include <mutex>
 #include <memory>
+#include <new>
 #include <vector>
+#include <array>
+#include <iterator>
+#include <algorithm>
+
+#include "LockfreePageDirectory.h"
+#include "LockfreeEpoch.h"
+#include "LockfreeScan.h"
+#include "LockfreeParallel.h"
+#include "LockfreeSet.h"
+#include "LockfreeStats.h"
+#include "LockfreeLatency.h"
 
 /**
  * T is the content type and must be integral
  * N elements per page
  * S sentinel element
- * B counter bits, assert B <= 16, N < 2^B
+ * B counter bits, assert B <= 16, N + threads < 2^B (a push() that finds its page full overshoots the index by one)
  * M pages per arena
+ * K pages per thread-local magazine, assert M + threads * K < 2^B
+ * 
+ * Pages hold N elements followed by the pointer to the next page and a commit counter.
+ * The counter is incremented after the elements are written, a page is sealed when it reaches N.
+ * Each key has a header of one cache line whose remaining space is an inline page of I elements, 
+ * pages are taken from the arenas once it is full. Pointers to the inline page are tagged (LOCAL), 
+ * so writers and readers learn the size of a page from the pointer.
+ * Pages of cleared keys are recycled through a free-list, readers that might run concurrently 
+ * with clear() must hold a guard from protect() while iterating.
+ * push_unique() keeps a set of the values it added per key (see LockfreeSet) to reject duplicates.
  * */
-template<typename T = uint32_t, unsigned int N = 1000, T S = 0, unsigned int B = 16, unsigned int M = 2048>
+template<typename T = uint32_t, unsigned int N = 1000, T S = 0, unsigned int B = 16, unsigned int M = 2048, unsigned int K = 16>
 class LockfreeMap2 {
 public:
+    static constexpr uintptr_t LOCAL = 2; // tag of pointers to an inline page (bit 0 is used by the page directory)
+    static constexpr unsigned int I = (64 - 5 * sizeof(void*)) / sizeof(T); // elements of the inline page
+    static constexpr unsigned int RELEASED = ~0u; // commit counter of an inline page that can be reused
+
     class const_iterator {
         T* pos;
         T** cpe; // current page end
+        unsigned int left; // committed elements left on this page, including *pos
+        bool sealed; // all elements of this page are committed
+
+        inline void skip_holes() {
+            while (*pos == S) ++pos; // slot claimed by a writer that has not committed yet
+        }
+
+        inline void enter(T* page) { 
+            // position at the first committed element in page or the pages after
+            while (page != nullptr) {
+                cpe = end_of(page);
+                left = committed(page).load(std::memory_order_acquire);
+                if (left > 0) {
+                    pos = untag(page);
+                    sealed = (left == capacity(page));
+                    if (!sealed) skip_holes();
+                    return;
+                }
+                page = *cpe;
+            }
+            pos = nullptr;
+        }
 
     public:
-        const_iterator(T* mem) : pos(mem), cpe((T**)(mem + N)) { }
+        typedef std::forward_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef T reference;
+
+        const_iterator(T* page = nullptr) : pos(nullptr), cpe(nullptr), left(0), sealed(false) { 
+            enter(page);
+        }
+
+        const_iterator(T* pos_, T* page) : pos(pos_), cpe(end_of(page)), left(0), sealed(false) { 
+            unsigned int c = committed(page).load(std::memory_order_acquire);
+            if (c == capacity(page)) {
+                left = (T*)cpe - pos;
+                sealed = true;
+            }
+            else {
+                for (T* p = pos; p < (T*)cpe; p++) left += (*p != S);
+                left = std::min(left, c);
+                if (left > 0) skip_holes();
+                else enter(*cpe);
+            }
+        }
+
         ~const_iterator() { }
 
-        inline const T operator * () { 
+        inline T operator * () const { 
             assert(pos != nullptr);
             return *pos; 
         }
 
         inline const_iterator& operator ++ () { 
             ++pos; 
-            if (pos == (T*)cpe) { // hop from cpe to next page begin
-                pos = *cpe; 
-                if (pos != nullptr) cpe = (T**)(pos + N); 
-            }
-            if (pos != nullptr && *pos == S) pos = nullptr;
+            if (--left == 0) enter(*cpe); // hop to next page
+            else if (!sealed) skip_holes(); // sealed pages need no sentinel checks
             return *this; 
         }
 
-        inline bool operator != (const const_iterator& other) { // page end and next page begin are equal
+        inline const_iterator operator ++ (int) { 
+            const_iterator it = *this;
+            ++*this;
+            return it; 
+        }
+
+        inline bool operator != (const const_iterator& other) const { // page end and next page begin are equal
             return pos != other.pos;    
         }
 
@@ -69,6 +143,27 @@ public:
         }
     };
 
+    static inline T* untag(T* page) {
+        return (T*)((uintptr_t)page & ~LOCAL);
+    }
+
+    static inline unsigned int capacity(T* page) {
+        return ((uintptr_t)page & LOCAL) ? I : N;
+    }
+
+    static inline T** end_of(T* page) {
+        return (T**)(untag(page) + capacity(page));
+    }
+
+    static inline std::atomic<unsigned int>& committed(T* page) {
+        return *(std::atomic<unsigned int>*)(end_of(page) + 1);
+    }
+
+    static inline void set_next(T* page, T* next) {
+        T** cpe = end_of(page);
+        *cpe = next; // glue the segments
+    }
+
     static inline unsigned int get_index(uintptr_t pos) {
         return pos & ((1 << B) - 1);
     }
@@ -77,71 +172,250 @@ public:
         return (T*)(pos >> B);
     }
 
+    template<typename Iterator>
+    static inline Iterator copy_run(Iterator first, T* dest, unsigned int k) {
+        for (unsigned int j = 0; j < k; ++j, ++first) {
+            assert(*first != S);
+            dest[j] = *first;
+        }
+        return first;
+    }
+
 private:    
-    class LockfreeVector9 {
-        T* memory;
+    /**
+     * Header of one key, the page directory lists the pages after the first one
+     * */
+    class alignas(64) LockfreeVector9 {
         std::atomic<uintptr_t> pos;
-        LockfreeMap2* map;
+        std::atomic<T*> memory;
+        LockfreePageDirectory<T> directory;
+        alignas(T*) unsigned char local[I * sizeof(T) + 2 * sizeof(T*)]; // inline page
 
         LockfreeVector9(LockfreeVector9 const&) = delete;
         void operator=(LockfreeVector9 const&) = delete;
         LockfreeVector9(LockfreeVector9&& other) = delete;
 
-    public:
-        LockfreeVector9(LockfreeMap2* map_) : map(map_) {
-            //memory = map->allocate();//
-            memory = (T*)std::malloc(N * sizeof(T) + sizeof(T*));
-            pos.store((uintptr_t)memory << B, std::memory_order_relaxed);
-            std::fill(memory, memory + N, S);
-            T** cpe = (T**)(memory + N);
-            *cpe = nullptr; // to glue the segments together
-        }
-
-        ~LockfreeVector9() { 
-            T* mem = memory;
-            while (mem != nullptr) {
-                memory = *(T**)(mem + N);
-                free(mem);
-                mem = memory;
+        inline T* inline_page() {
+            return (T*)((uintptr_t)local | LOCAL);
+        }
+
+        T* reset_inline_page() {
+            T* page = inline_page();
+            std::fill(untag(page), untag(page) + I, S);
+            set_next(page, nullptr);
+            new (&committed(page)) std::atomic<unsigned int>(0);
+            return page;
+        }
+
+        // the inline page starts a chain unless it is still part of a chain detached by clear()
+        T* next_page(LockfreeMap2* map, T* mem) {
+            map->stats.add(LockfreeStats::PAGE_SWITCHES);
+            if (mem == nullptr && committed(inline_page()).load(std::memory_order_acquire) == RELEASED) {
+                return reset_inline_page();
+            }
+            return map->allocate();
+        }
+
+        // called by the thread that claimed the last index of mem, the first m slots of the fresh page are its own
+        void switch_page(T* mem, T* fresh, unsigned int m) {
+            //^^^^^^ until here it's uncritical
+            if (mem != nullptr) {
+                directory.append(fresh);
+                set_next(mem, fresh); //now readers know about the new page
+            }
+            else { // first page after clear()
+                memory.store(fresh, std::memory_order_release);
             }
+            pos.store(((uintptr_t)fresh << B) + m, std::memory_order_release);
         }
 
-        void push(T value) {
+        /**
+         * Page holding slot i, j is set to the position of i in the page, expects i < size()
+         * Returns nullptr if the list was cleared since, guarded readers may call it concurrently with clear().
+         * */
+        inline T* locate(size_t i, size_t& j) const {
+            T* first = memory.load(std::memory_order_acquire);
+            if (first == nullptr) return nullptr;
+            if (i < capacity(first)) {
+                j = i;
+                return first;
+            }
+            i -= capacity(first);
+            j = i % N;
+            return directory[i / N];
+        }
+
+    public:
+        LockfreeVector9() {
+            T* page = reset_inline_page();
+            memory.store(page, std::memory_order_relaxed);
+            pos.store((uintptr_t)page << B, std::memory_order_relaxed);
+        }
+
+        ~LockfreeVector9() { } // pages belong to the arenas
+
+        void push(LockfreeMap2* map, T value) {
             assert(value != S);
             while (true) {
                 uintptr_t cur = pos.load(std::memory_order_acquire);
                 unsigned int i = get_index(cur);
-                if (i <= N) { // block pos++ during realloc (busy-loop)
+                if (i <= capacity(get_page(cur))) { // block pos++ during realloc (busy-loop)
                     cur = pos.fetch_add(1, std::memory_order_acq_rel);
                     i = get_index(cur);
                     T* mem = get_page(cur);
-                    if (i < N) { 
-                        mem[i] = value;
+                    unsigned int n = capacity(mem);
+                    if (i < n) { 
+                        untag(mem)[i] = value;
+                        committed(mem).fetch_add(1, std::memory_order_release);
                         return;
                     }
-                    else if (i == N) { // all smaller pos are allocated
-                        T* fresh = map->allocate();//
-                        // T* fresh = (T*)std::malloc(N * sizeof(T) + sizeof(T*));
-                        // std::fill(fresh, fresh + N, S);
-                        T** cpe = (T**)(fresh + N);
-                        *cpe = nullptr;
-                        //^^^^^^ until here it's uncritical
-                        cpe = (T**)(mem + N);
-                        *cpe = fresh; //now readers know about the new page
-                        pos.store((uintptr_t)fresh << B, std::memory_order_acq_rel);
+                    else if (i == n) { // all smaller pos are allocated
+                        switch_page(mem, next_page(map, mem), 0);
                     } // loop to construct first element in new page
+                    else map->stats.add(LockfreeStats::SPINS);
+                }
+                else map->stats.add(LockfreeStats::SPINS);
+            }
+        }
+
+        /**
+         * Push [first, last) with one CAS per page (see LockfreeVector9::push(first, last))
+         * */
+        template<typename Iterator>
+        void push(LockfreeMap2* map, Iterator first, Iterator last) {
+            size_t rest = std::distance(first, last);
+            while (rest > 0) {
+                uintptr_t cur = pos.load(std::memory_order_acquire);
+                unsigned int i = get_index(cur);
+                T* mem = get_page(cur);
+                unsigned int n = capacity(mem);
+                if (i <= n) { // block pos+=k during realloc (busy-loop)
+                    // the run that covers the last index claims one more slot, i.e. the page switch
+                    unsigned int k = rest <= n - i ? (unsigned int)rest : n - i + 1;
+                    if (!pos.compare_exchange_weak(cur, cur + k, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                        map->stats.add(LockfreeStats::SPINS);
+                    }
+                    else if (i + k <= n) {
+                        first = copy_run(first, untag(mem) + i, k);
+                        committed(mem).fetch_add(k, std::memory_order_release);
+                        rest -= k;
+                    }
+                    else { // run covers the last index, i.e. all smaller pos are allocated
+                        first = copy_run(first, untag(mem) + i, n - i);
+                        if (i < n) committed(mem).fetch_add(n - i, std::memory_order_release);
+                        rest -= n - i;
+                        T* fresh = next_page(map, mem);
+                        unsigned int m = (unsigned int)std::min<size_t>(rest, capacity(fresh));
+                        switch_page(mem, fresh, m);
+                        first = copy_run(first, untag(fresh), m);
+                        if (m > 0) committed(fresh).fetch_add(m, std::memory_order_release);
+                        rest -= m;
+                    }
                 }
+                else map->stats.add(LockfreeStats::SPINS);
             }
         }
 
+        /**
+         * Detach the page chain, the next push starts a fresh one. 
+         * Claims the remaining slots of the current page like a push that switches pages, 
+         * but installs the empty state (no page, index N) instead of a fresh page. 
+         * Pushes that claimed a slot before complete on the old chain, which is recycled once 
+         * all its claimed slots are committed and no reader holding a guard can see it.
+         * */
+        void clear(LockfreeMap2* map) {
+            while (true) {
+                uintptr_t cur = pos.load(std::memory_order_acquire);
+                unsigned int i = get_index(cur);
+                if (get_page(cur) == nullptr) return; // empty
+                unsigned int n = capacity(get_page(cur));
+                if (i <= n) { // block during realloc (busy-loop)
+                    // claim the rest of the page and the switch, i.e. move the index to n + 1
+                    if (pos.compare_exchange_weak(cur, cur + (n - i + 1), std::memory_order_acq_rel, std::memory_order_acquire)) {
+                        T* head = memory.load(std::memory_order_relaxed);
+                        memory.store(nullptr, std::memory_order_release);
+                        directory.clear([map] (void* table) { map->domain.retire(table); });
+                        pos.store((uintptr_t)N, std::memory_order_release);
+                        map->retire(head, get_page(cur), i);
+                        return;
+                    }
+                }
+                map->stats.add(LockfreeStats::SPINS);
+            }
+        }
+
+        // number of claimed slots (see LockfreeVector9::size())
+        inline size_t size() const {
+            while (true) {
+                uintptr_t cur = pos.load(std::memory_order_acquire);
+                T* page = get_page(cur);
+                if (page == nullptr) return 0;
+                T* first = memory.load(std::memory_order_acquire);
+                if (page == first) return std::min(get_index(cur), capacity(page));
+                unsigned int pages = directory.size_if_back(page);
+                if (pages > 0 && first != nullptr) { // retry during page switch
+                    return capacity(first) + (size_t)(pages-1) * N + std::min(get_index(cur), N);
+                }
+            }
+        }
+
+        // expects i < size(), S if the list was cleared since
+        inline T operator [] (size_t i) const {
+            size_t j;
+            T* page = locate(i, j);
+            return page != nullptr ? untag(page)[j] : S;
+        }
+
+        inline const_iterator seek(size_t i) const {
+            if (i >= size()) return end();
+            size_t j;
+            T* page = locate(i, j);
+            if (page == nullptr) return end(); // cleared since
+            return const_iterator(untag(page) + j, page);
+        }
+
         inline const_iterator begin() const {
-            // std::cout << std::this_thread::get_id() << " begin: " << memory << std::endl;
-            return const_iterator((*memory == S) ? nullptr : memory);
+            return const_iterator(memory.load(std::memory_order_acquire));
         }
 
         inline const_iterator end() const {
             return const_iterator(nullptr);
         }
+
+        /**
+         * Call f(first, n) on the committed runs of the pages until it returns true, unsealed pages 
+         * are cut at their first uncommitted slot (sentinel frontier). Returns whether f stopped the scan.
+         * */
+        template<typename F>
+        bool scan(F f) const {
+            for (T* page = memory.load(std::memory_order_acquire); page != nullptr; page = *end_of(page)) {
+                T* mem = untag(page);
+                unsigned int n = capacity(page);
+                if (committed(page).load(std::memory_order_acquire) < n) n = (unsigned int)LockfreeScan::find(mem, n, S);
+                if (n > 0 && f((const T*)mem, n)) return true;
+            }
+            return false;
+        }
+
+        // number of elements equal to value (see LockfreeScan)
+        inline size_t count(T value) const {
+            return LockfreeScan::count(*this, value);
+        }
+
+        inline bool contains(T value) const {
+            return LockfreeScan::contains(*this, value);
+        }
+
+        // first element for which pred returns true
+        template<typename Predicate>
+        inline bool find_first(Predicate pred, T& value) const {
+            return LockfreeScan::find_first(*this, pred, value);
+        }
+
+        // append the elements in [lo, hi] to out, returns their number
+        inline size_t filter(T lo, T hi, std::vector<T>& out) const {
+            return LockfreeScan::filter(*this, lo, hi, out);
+        }
     };
 
     LockfreeVector9* map; 
@@ -149,50 +423,204 @@ private:
 
     std::vector<T*> arenas;
     std::atomic<uintptr_t> pos;
+    const uint64_t id; // identifies this map in the thread-local magazines
+
+    // lock-free stack of recycled pages linked by their next pointers, tagged against ABA
+    struct alignas(2*sizeof(void*)) FreePages {
+        T* page;
+        uintptr_t tag;
+    };
+    alignas(2*sizeof(void*)) std::atomic<FreePages> free_pages;
+    std::atomic<size_t> n_free; // avoids double-word loads while the stack is empty
+
+    LockfreeEpoch domain; // delays recycling of cleared pages
+    mutable LockfreeStats stats;
+
+    typedef LockfreeSet<T, S> Filter;
+    std::atomic<Filter*> filters; // one per key, allocated on first push_unique()
+
+    // page chain detached by clear()
+    struct Detached {
+        LockfreeMap2* map;
+        T* head;
+        T* last;
+        unsigned int claimed; // claimed slots in last
+    };
+
+    void release(T* page) {
+        FreePages head = free_pages.load(std::memory_order_relaxed);
+        set_next(page, head.page);
+        while (!free_pages.compare_exchange_weak(head, { page, head.tag + 1 }, std::memory_order_release, std::memory_order_relaxed)) {
+            stats.add(LockfreeStats::CAS_FAILURES);
+            set_next(page, head.page);
+        }
+        n_free.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    T* reuse() {
+        if (n_free.load(std::memory_order_relaxed) == 0) return nullptr;
+        FreePages head = free_pages.load(std::memory_order_acquire);
+        while (head.page != nullptr) {
+            T* next = *(T**)(head.page + N); // page might be popped and reused meanwhile, then the tag has changed
+            if (free_pages.compare_exchange_weak(head, { next, head.tag + 1 }, std::memory_order_acquire, std::memory_order_acquire)) {
+                n_free.fetch_sub(1, std::memory_order_relaxed);
+                return head.page;
+            }
+            stats.add(LockfreeStats::CAS_FAILURES);
+        }
+        return nullptr;
+    }
+
+    // reclaim function for detached chains, declines while claimed slots are not committed
+    static bool recycle(void* ptr) {
+        LOCKFREE_LATENCY_SCOPE(RECLAIM_WAIT);
+        Detached* chain = (Detached*)ptr;
+        for (T* page = chain->head; ; page = *end_of(page)) {
+            unsigned int c = (page == chain->last) ? chain->claimed : capacity(page);
+            if (committed(page).load(std::memory_order_acquire) < c) {
+                chain->map->stats.add(LockfreeStats::RECLAIM_WAITS);
+                return false;
+            }
+            if (page == chain->last) break;
+        }
+        T* page = chain->head;
+        while (true) {
+            T* next = *end_of(page);
+            bool last = (page == chain->last);
+            if ((uintptr_t)page & LOCAL) committed(page).store(RELEASED, std::memory_order_release);
+            else chain->map->release(page);
+            if (last) break;
+            page = next;
+        }
+        delete chain;
+        return true;
+    }
+
+    void retire(T* head, T* last, unsigned int claimed) {
+        domain.retire(new Detached { this, head, last, claimed }, recycle);
+    }
+
+    /**
+     * Run of pages pre-carved from an arena for the exclusive use of one thread
+     * Pages left in a magazine when its thread is done stay unused until the map is destroyed
+     * Map ids are never reused, so a magazine of a destroyed map never matches a live one, 
+     * the destroying thread frees its own entry and other threads evict theirs like any other.
+     * */
+    struct Magazine {
+        uint64_t owner;
+        uintptr_t next;
+        unsigned int left;
+    };
+
+    static uint64_t next_id() {
+        static std::atomic<uint64_t> ids { 1 };
+        return ids.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static std::array<Magazine, 4>& magazines() {
+        static thread_local std::array<Magazine, 4> magazines { };
+        return magazines;
+    }
+
+    // magazine of the calling thread for this map, threads cache magazines of the last four maps, free entries first
+    Magazine& magazine() {
+        static thread_local unsigned int victim = 0;
+        Magazine* free = nullptr;
+        for (Magazine& mag : magazines()) {
+            if (mag.owner == id) return mag;
+            if (mag.owner == 0 && free == nullptr) free = &mag;
+        }
+        Magazine& mag = (free != nullptr) ? *free : magazines()[victim++ % magazines().size()];
+        mag = { id, 0, 0 };
+        return mag;
+    }
+
+    // refill mag with up to K pages of the current arena using a single fetch_add
+    void refill(Magazine& mag) {
+        while (true) {
+            uintptr_t cur = pos.load(std::memory_order_acquire);
+            unsigned int i = get_index(cur);
+            if (i <= M) { // block pos+=k during realloc (busy-loop)
+                unsigned int k = i < M ? std::min(K, M - i) : 1;
+                cur = pos.fetch_add(k, std::memory_order_acq_rel);
+                i = get_index(cur);
+                if (i + k <= M) {
+                    mag.next = (cur >> B) + i * pagebytes();
+                    mag.left = k;
+                    return;
+                }
+                else if (i < M) { // run covers M, take the rest of this arena
+                    mag.next = (cur >> B) + i * pagebytes();
+                    mag.left = M - i;
+                    new_arena(0);
+                    stats.add(LockfreeStats::GROWS);
+                    return;
+                }
+                else if (i == M) { // claim the first K pages of the next arena
+                    mag.next = new_arena(K);
+                    mag.left = K;
+                    stats.add(LockfreeStats::GROWS);
+                    return;
+                }
+            }
+            stats.add(LockfreeStats::SPINS); // waiting for the next arena
+        }
+    }
 
     LockfreeMap2(LockfreeMap2 const&) = delete;
     void operator=(LockfreeMap2 const&) = delete;
     LockfreeMap2(LockfreeMap2&& other) = delete;
 
     static inline uintptr_t pagebytes() {
-        return N * sizeof(T) + sizeof(T*);
+        return N * sizeof(T) + 2 * sizeof(T*);
     }
 
-    void new_arena() {
+    // called by the thread that claimed index M, the first claimed pages are taken by the caller
+    uintptr_t new_arena(unsigned int claimed) {
         uintptr_t arena = (uintptr_t)std::malloc(M * pagebytes());
         std::fill((T*)arena, (T*)(arena + M * pagebytes()), S);
         arenas.push_back((T*)arena);
-        pos.store(arena << B, std::memory_order_relaxed);
+        pos.store((arena << B) + claimed, std::memory_order_release);
+        return arena;
     }
 
 public:
-    LockfreeMap2(unsigned int n) : size_(n), arenas() {
-        new_arena();
-        map = (LockfreeVector9*)std::calloc(size_, sizeof(LockfreeVector9));
+    LockfreeMap2(unsigned int n) : size_(n), arenas(), id(next_id()), free_pages(FreePages { nullptr, 0 }), n_free(0), domain(), filters(nullptr) {
+        static_assert(sizeof(LockfreeVector9) == 64, "key header exceeds a cache line");
+        new_arena(0);
+        map = (LockfreeVector9*)std::aligned_alloc(alignof(LockfreeVector9), size_ * sizeof(LockfreeVector9));
         for (unsigned int i = 0; i < size_; i++) {
-            new ((void*)(&map[i])) LockfreeVector9(this);
+            new ((void*)(&map[i])) LockfreeVector9();
         }
     }
 
     ~LockfreeMap2() { 
+        for (Magazine& mag : magazines()) {
+            if (mag.owner == id) mag = { 0, 0, 0 };
+        }
+        domain.drain();
         for (T* arena : arenas) free(arena);
+        for (unsigned int i = 0; i < size_; i++) map[i].~LockfreeVector9();
         free(map);
+        delete[] filters.load(std::memory_order_relaxed);
     }
 
+    // prefers recycled pages, the shared arena cursor is touched once per K fresh pages
     T* allocate() {
-        while (true) {
-            uintptr_t cur = pos.load(std::memory_order_acquire);
-            if (get_index(cur) <= M) { // block pos++ during realloc (busy-loop)
-                cur = pos.fetch_add(1, std::memory_order_acq_rel);
-                unsigned int i = get_index(cur);
-                if (i < M) { 
-                    return (T*) ((cur >> B) + i * pagebytes());
-                }
-                else if (i == M) {
-                    new_arena();
-                }
-            }
+        T* page = reuse();
+        if (page != nullptr) {
+            std::fill(page, page + N, S);
         }
+        else {
+            Magazine& mag = magazine();
+            if (mag.left == 0) refill(mag);
+            page = (T*)mag.next;
+            mag.next += pagebytes();
+            mag.left--;
+        }
+        set_next(page, nullptr);
+        new (&committed(page)) std::atomic<unsigned int>(0);
+        return page;
     }
 
     unsigned int size() const {
@@ -200,13 +628,89 @@ public:
     }
 
     void push(T key, T value) {
-        map[key].push(value);
+        map[key].push(this, value);
+    }
+
+    // contention and retry counters of the map and its lists (see LockfreeStats)
+    inline LockfreeStats& statistics() const {
+        return stats;
+    }
+
+    // pages waiting in the free-list for reuse
+    inline size_t recycled_pages() const {
+        return n_free.load(std::memory_order_relaxed);
+    }
+
+    // pages of all arenas, exact while no push runs concurrently
+    inline size_t reserved_pages() const {
+        return arenas.size() * M;
+    }
+
+    // readers that may run concurrently with clear() hold a guard while iterating
+    inline LockfreeEpoch::guard protect() {
+        return LockfreeEpoch::guard(domain);
+    }
+
+    /**
+     * Push value unless push_unique() added it to the list of key before, returns whether it was pushed.
+     * Of concurrent calls with the same value exactly one succeeds, values added by push() are not checked. 
+     * */
+    bool push_unique(T key, T value) {
+        Filter* f = filters.load(std::memory_order_acquire);
+        if (f == nullptr) { // concurrent allocations are resolved by CAS
+            Filter* fresh = new Filter[size_];
+            if (filters.compare_exchange_strong(f, fresh, std::memory_order_acq_rel)) f = fresh;
+            else delete[] fresh;
+        }
+        if (!f[key].insert(value)) return false;
+        map[key].push(this, value);
+        return true;
+    }
+
+    /**
+     * Empty the list of key, its pages are recycled (see LockfreeVector9::clear()).
+     * The values are forgotten by push_unique(), calls overlapping clear() may be checked against either list.
+     * */
+    void clear(T key) {
+        map[key].clear(this);
+        Filter* f = filters.load(std::memory_order_acquire);
+        if (f != nullptr) {
+            void* tables = f[key].detach();
+            if (tables != nullptr) domain.retire(tables, Filter::reclaim);
+        }
+    }
+
+    template<typename Iterator>
+    void push(T key, Iterator first, Iterator last) {
+        map[key].push(this, first, last);
     }
 
     const LockfreeVector9& operator [] (T key) const {
         return map[key];
     }
 
+    // splittable range of the keys (see LockfreeParallel), e.g. for tbb::parallel_for() or std::for_each(std::execution::par, ...)
+    inline LockfreeParallel::index_range<unsigned int> keys(size_t grain = 1) const {
+        return LockfreeParallel::index_range<unsigned int>(0, size(), grain);
+    }
+
+    // call f(key, value) on the elements of all keys with the keys spread over threads
+    template<typename F>
+    void parallel_for_each(F f, unsigned int threads = LockfreeParallel::concurrency()) const {
+        LockfreeParallel::for_each(keys(), [this, &f] (const LockfreeParallel::index_range<unsigned int>& range) { 
+            for (unsigned int key : range) for (T value : (*this)[key]) f((T)key, value); 
+        }, threads);
+    }
+
+    // join of acc = f(acc, key, value) over the elements per key range, init is the identity of join
+    template<typename V, typename F, typename Join>
+    V parallel_reduce(V init, F f, Join join, unsigned int threads = LockfreeParallel::concurrency()) const {
+        return LockfreeParallel::reduce(keys(), init, [this, &f] (const LockfreeParallel::index_range<unsigned int>& range, V acc) { 
+            for (unsigned int key : range) for (T value : (*this)[key]) acc = f(acc, (T)key, value); 
+            return acc;
+        }, join, threads);
+    }
+
 };
 
 #endif
\ No newline at end of file
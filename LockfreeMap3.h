@@ -25,41 +25,114 @@ OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWA
 #include <atomic>
 #include <mutex>
 #include <memory>
+#include <new>
 #include <vector>
+#include <iterator>
+#include <algorithm>
+
+#include "LockfreePageDirectory.h"
+#include "LockfreeEpoch.h"
+#include "LockfreeScan.h"
+#include "LockfreeParallel.h"
+#include "LockfreeWait.h"
+#include "LockfreeSet.h"
+#include "LockfreeStats.h"
+#include "LockfreeLatency.h"
 
 /**
  * T is the content type and must be integral
  * N elements per page
  * S sentinel element
- * B counter bits, assert B <= 16, N < 2^B
+ * B counter bits, assert B <= 16, N + threads < 2^B (a push() that finds its page full overshoots the index by one)
+ * 
+ * Pages hold N elements followed by the pointer to the next page and a commit counter.
+ * The counter is incremented after the elements are written, a page is sealed when it reaches N.
+ * Each key has a header of one cache line whose remaining space is an inline page of I elements 
+ * (see LockfreeMap2), pages are allocated once it is full.
+ * Keys from size() on are added on first access, the key directory grows without moving headers.
+ * Pages of cleared keys are freed once unreachable, readers that might run concurrently 
+ * with clear() must hold a guard from protect() while iterating.
+ * push_unique() keeps a set of the values it added per key (see LockfreeSet) to reject duplicates.
  * */
 template<typename T = uint32_t, unsigned int N = 1000, T S = 0, unsigned int B = 16>
 class LockfreeMap3 {
 public:
+    static constexpr uintptr_t LOCAL = 2; // tag of pointers to an inline page (bit 0 is used by the page directory)
+    static constexpr unsigned int I = (64 - 5 * sizeof(void*)) / sizeof(T); // elements of the inline page
+    static constexpr unsigned int RELEASED = ~0u; // commit counter of an inline page that can be reused
+
     class const_iterator {
         T* pos;
         T** cpe; // current page end
+        unsigned int left; // committed elements left on this page, including *pos
+        bool sealed; // all elements of this page are committed
+
+        inline void skip_holes() {
+            while (*pos == S) ++pos; // slot claimed by a writer that has not committed yet
+        }
+
+        inline void enter(T* page) { 
+            // position at the first committed element in page or the pages after
+            while (page != nullptr) {
+                cpe = end_of(page);
+                left = committed(page).load(std::memory_order_acquire);
+                if (left > 0) {
+                    pos = untag(page);
+                    sealed = (left == capacity(page));
+                    if (!sealed) skip_holes();
+                    return;
+                }
+                page = *cpe;
+            }
+            pos = nullptr;
+        }
 
     public:
-        const_iterator(T* mem) : pos(mem), cpe((T**)(mem + N)) { }
+        typedef std::forward_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef T reference;
+
+        const_iterator(T* page = nullptr) : pos(nullptr), cpe(nullptr), left(0), sealed(false) { 
+            enter(page);
+        }
+
+        const_iterator(T* pos_, T* page) : pos(pos_), cpe(end_of(page)), left(0), sealed(false) { 
+            unsigned int c = committed(page).load(std::memory_order_acquire);
+            if (c == capacity(page)) {
+                left = (T*)cpe - pos;
+                sealed = true;
+            }
+            else {
+                for (T* p = pos; p < (T*)cpe; p++) left += (*p != S);
+                left = std::min(left, c);
+                if (left > 0) skip_holes();
+                else enter(*cpe);
+            }
+        }
+
         ~const_iterator() { }
 
-        inline const T operator * () { 
+        inline T operator * () const { 
             assert(pos != nullptr);
             return *pos; 
         }
 
         inline const_iterator& operator ++ () { 
             ++pos; 
-            if (pos == (T*)cpe) { // hop from cpe to next page begin
-                pos = *cpe; 
-                if (pos != nullptr) cpe = (T**)(pos + N); 
-            }
-            if (pos != nullptr && *pos == S) pos = nullptr;
+            if (--left == 0) enter(*cpe); // hop to next page
+            else if (!sealed) skip_holes(); // sealed pages need no sentinel checks
             return *this; 
         }
 
-        inline bool operator != (const const_iterator& other) {
+        inline const_iterator operator ++ (int) { 
+            const_iterator it = *this;
+            ++*this;
+            return it; 
+        }
+
+        inline bool operator != (const const_iterator& other) const { // page end and next page begin are equal
             return pos != other.pos;    
         }
 
@@ -68,6 +141,27 @@ public:
         }
     };
 
+    static inline T* untag(T* page) {
+        return (T*)((uintptr_t)page & ~LOCAL);
+    }
+
+    static inline unsigned int capacity(T* page) {
+        return ((uintptr_t)page & LOCAL) ? I : N;
+    }
+
+    static inline T** end_of(T* page) {
+        return (T**)(untag(page) + capacity(page));
+    }
+
+    static inline std::atomic<unsigned int>& committed(T* page) {
+        return *(std::atomic<unsigned int>*)(end_of(page) + 1);
+    }
+
+    static inline void set_next(T* page, T* next) {
+        T** cpe = end_of(page);
+        *cpe = next; // glue the segments
+    }
+
     static inline unsigned int get_index(uintptr_t pos) {
         return pos & ((1 << B) - 1);
     }
@@ -76,99 +170,528 @@ public:
         return (T*)(pos >> B);
     }
 
+    template<typename Iterator>
+    static inline Iterator copy_run(Iterator first, T* dest, unsigned int k) {
+        for (unsigned int j = 0; j < k; ++j, ++first) {
+            assert(*first != S);
+            dest[j] = *first;
+        }
+        return first;
+    }
+
+    // position of a tailing reader, a default constructed cursor starts at the beginning
+    struct cursor {
+        T* page = nullptr;
+        unsigned int index = 0;
+    };
+
 private:    
-    class LockfreeVector9 {
-        T* memory;
+    // page chain detached by clear()
+    struct Detached {
+        T* head;
+        T* last;
+        unsigned int claimed; // claimed slots in last
+        LockfreeStats* stats;
+    };
+
+    static inline void tally(LockfreeStats* stats, LockfreeStats::Counter c) {
+        if (stats != nullptr) stats->add(c);
+    }
+
+    // reclaim function for detached chains, declines while claimed slots are not committed
+    static bool reclaim(void* ptr) {
+        LOCKFREE_LATENCY_SCOPE(RECLAIM_WAIT);
+        Detached* chain = (Detached*)ptr;
+        for (T* page = chain->head; ; page = *end_of(page)) {
+            unsigned int c = (page == chain->last) ? chain->claimed : capacity(page);
+            if (committed(page).load(std::memory_order_acquire) < c) {
+                tally(chain->stats, LockfreeStats::RECLAIM_WAITS);
+                return false;
+            }
+            if (page == chain->last) break;
+        }
+        T* page = chain->head;
+        while (true) {
+            T* next = *end_of(page);
+            bool last = (page == chain->last);
+            if ((uintptr_t)page & LOCAL) committed(page).store(RELEASED, std::memory_order_release);
+            else free(page);
+            if (last) break;
+            page = next;
+        }
+        delete chain;
+        return true;
+    }
+
+    /**
+     * Header of one key, the page directory lists the pages after the first one
+     * */
+    class alignas(64) LockfreeVector9 {
         std::atomic<uintptr_t> pos;
+        std::atomic<T*> memory;
+        LockfreePageDirectory<T> directory;
+        alignas(T*) unsigned char local[I * sizeof(T) + 2 * sizeof(T*)]; // inline page
 
         LockfreeVector9(LockfreeVector9 const&) = delete;
         void operator=(LockfreeVector9 const&) = delete;
         LockfreeVector9(LockfreeVector9&& other) = delete;
 
-        void set_next(T* page, T* next) {
-            T** cpe = (T**)(page + N);
-            *cpe = next; // glue the segments
-        }
-
         T* new_page() {
-            T* page = (T*)std::malloc(N * sizeof(T) + sizeof(T*));
+            T* page = (T*)std::malloc(N * sizeof(T) + 2 * sizeof(T*));
             std::fill(page, page + N, S);
             set_next(page, nullptr);
+            new (&committed(page)) std::atomic<unsigned int>(0);
             return page;
         }
 
+        // threads in wait_for_new(), shares the pointer-sized counter slot of the inline page
+        inline std::atomic<uint32_t>& waiters() const {
+            static_assert(sizeof(T*) >= 2 * sizeof(uint32_t), "no room for the waiter count");
+            return *((std::atomic<uint32_t>*)(end_of((T*)((uintptr_t)local | LOCAL)) + 1) + 1);
+        }
+
+        inline T* inline_page() {
+            return (T*)((uintptr_t)local | LOCAL);
+        }
+
+        T* reset_inline_page() {
+            T* page = inline_page();
+            std::fill(untag(page), untag(page) + I, S);
+            set_next(page, nullptr);
+            new (&committed(page)) std::atomic<unsigned int>(0);
+            return page;
+        }
+
+        // the inline page starts a chain unless it is still part of a chain detached by clear()
+        T* next_page(T* mem, LockfreeStats* stats) {
+            tally(stats, LockfreeStats::PAGE_SWITCHES);
+            if (mem == nullptr && committed(inline_page()).load(std::memory_order_acquire) == RELEASED) {
+                return reset_inline_page();
+            }
+            return new_page();
+        }
+
+        // called by the thread that claimed the last index of mem, the first m slots of the fresh page are its own
+        void switch_page(T* mem, T* fresh, unsigned int m) {
+            //^^^^^^ until here it's uncritical
+            if (mem != nullptr) {
+                directory.append(fresh);
+                set_next(mem, fresh); //now readers know about the new page
+            }
+            else { // first page after clear()
+                memory.store(fresh, std::memory_order_release);
+            }
+            pos.store(((uintptr_t)fresh << B) + m, std::memory_order_release);
+        }
+
+        /**
+         * Page holding slot i, j is set to the position of i in the page, expects i < size()
+         * Returns nullptr if the list was cleared since, guarded readers may call it concurrently with clear().
+         * */
+        inline T* locate(size_t i, size_t& j) const {
+            T* first = memory.load(std::memory_order_acquire);
+            if (first == nullptr) return nullptr;
+            if (i < capacity(first)) {
+                j = i;
+                return first;
+            }
+            i -= capacity(first);
+            j = i % N;
+            return directory[i / N];
+        }
+
     public:
         LockfreeVector9() {
-            // memory = new_page();
-            // pos.store((uintptr_t)memory << B, std::memory_order_relaxed);
-            memory = nullptr;
-            pos.store((uintptr_t)N, std::memory_order_relaxed);
+            new (&waiters()) std::atomic<uint32_t>(0);
+            T* page = reset_inline_page();
+            memory.store(page, std::memory_order_relaxed);
+            pos.store((uintptr_t)page << B, std::memory_order_relaxed);
         }
 
         ~LockfreeVector9() { 
-            T* mem = memory;
+            T* mem = memory.load(std::memory_order_relaxed);
             while (mem != nullptr) {
-                memory = *(T**)(mem + N);
-                free(mem);
-                mem = memory;
+                T* next = *end_of(mem);
+                if (!((uintptr_t)mem & LOCAL)) free(mem);
+                mem = next;
             }
         }
 
-        void push(T value) {
+        // pushes through the map count to its statistics(), stats is nullptr for direct pushes
+        void push(T value, LockfreeStats* stats = nullptr) {
             assert(value != S);
             while (true) {
                 uintptr_t cur = pos.load(std::memory_order_acquire);
                 unsigned int i = get_index(cur);
-                if (i <= N) { // block pos++ during realloc (busy-loop)
+                if (i <= capacity(get_page(cur))) { // block pos++ during realloc (busy-loop)
                     cur = pos.fetch_add(1, std::memory_order_acq_rel);
                     i = get_index(cur);
                     T* mem = get_page(cur);
-                    if (i < N) { 
-                        mem[i] = value;
+                    unsigned int n = capacity(mem);
+                    if (i < n) { 
+                        untag(mem)[i] = value;
+                        committed(mem).fetch_add(1, std::memory_order_release);
+                        LockfreeWait::notify(this, waiters());
                         return;
                     }
-                    else if (i == N) { // all smaller pos are allocated
-                        T* page = new_page();
-                        if (mem != nullptr) set_next(mem, page);
-                        else memory = page; // initialization
-                        pos.store((uintptr_t)page << B, std::memory_order_acq_rel);
+                    else if (i == n) { // all smaller pos are allocated
+                        switch_page(mem, next_page(mem, stats), 0);
                     } // loop to construct first element in new page
+                    else tally(stats, LockfreeStats::SPINS);
+                }
+                else tally(stats, LockfreeStats::SPINS);
+            }
+        }
+
+        /**
+         * Push [first, last) with one CAS per page (see LockfreeVector9::push(first, last))
+         * */
+        template<typename Iterator>
+        void push(Iterator first, Iterator last, LockfreeStats* stats = nullptr) {
+            size_t rest = std::distance(first, last);
+            while (rest > 0) {
+                uintptr_t cur = pos.load(std::memory_order_acquire);
+                unsigned int i = get_index(cur);
+                T* mem = get_page(cur);
+                unsigned int n = capacity(mem);
+                if (i <= n) { // block pos+=k during realloc (busy-loop)
+                    // the run that covers the last index claims one more slot, i.e. the page switch
+                    unsigned int k = rest <= n - i ? (unsigned int)rest : n - i + 1;
+                    if (!pos.compare_exchange_weak(cur, cur + k, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                        tally(stats, LockfreeStats::SPINS);
+                    }
+                    else if (i + k <= n) {
+                        first = copy_run(first, untag(mem) + i, k);
+                        committed(mem).fetch_add(k, std::memory_order_release);
+                        rest -= k;
+                    }
+                    else { // run covers the last index, i.e. all smaller pos are allocated
+                        first = copy_run(first, untag(mem) + i, n - i);
+                        if (i < n) committed(mem).fetch_add(n - i, std::memory_order_release);
+                        rest -= n - i;
+                        T* fresh = next_page(mem, stats);
+                        unsigned int m = (unsigned int)std::min<size_t>(rest, capacity(fresh));
+                        switch_page(mem, fresh, m);
+                        first = copy_run(first, untag(fresh), m);
+                        if (m > 0) committed(fresh).fetch_add(m, std::memory_order_release);
+                        rest -= m;
+                    }
                 }
+                else tally(stats, LockfreeStats::SPINS);
             }
+            LockfreeWait::notify(this, waiters());
+        }
+
+        inline void push(const T* values, size_t n) {
+            push(values, values + n);
+        }
+
+        /**
+         * Detach the page chain, the next push starts a fresh one (see LockfreeMap2::LockfreeVector9::clear()).
+         * The old chain is retired to domain and freed once all its claimed slots are committed 
+         * and no reader holding a guard can see it.
+         * */
+        void clear(LockfreeEpoch& domain, LockfreeStats* stats = nullptr) {
+            while (true) {
+                uintptr_t cur = pos.load(std::memory_order_acquire);
+                unsigned int i = get_index(cur);
+                if (get_page(cur) == nullptr) return; // empty
+                unsigned int n = capacity(get_page(cur));
+                if (i <= n) { // block during realloc (busy-loop)
+                    // claim the rest of the page and the switch, i.e. move the index to n + 1
+                    if (pos.compare_exchange_weak(cur, cur + (n - i + 1), std::memory_order_acq_rel, std::memory_order_acquire)) {
+                        T* head = memory.load(std::memory_order_relaxed);
+                        memory.store(nullptr, std::memory_order_release);
+                        directory.clear([&domain] (void* table) { domain.retire(table); });
+                        pos.store((uintptr_t)N, std::memory_order_release);
+                        domain.retire(new Detached { head, get_page(cur), i, stats }, reclaim);
+                        return;
+                    }
+                }
+                tally(stats, LockfreeStats::SPINS);
+            }
+        }
+
+        // number of claimed slots (see LockfreeVector9::size())
+        inline size_t size() const {
+            while (true) {
+                uintptr_t cur = pos.load(std::memory_order_acquire);
+                T* page = get_page(cur);
+                if (page == nullptr) return 0;
+                T* first = memory.load(std::memory_order_acquire);
+                if (page == first) return std::min(get_index(cur), capacity(page));
+                unsigned int pages = directory.size_if_back(page);
+                if (pages > 0 && first != nullptr) { // retry during page switch
+                    return capacity(first) + (size_t)(pages-1) * N + std::min(get_index(cur), N);
+                }
+            }
+        }
+
+        // expects i < size(), S if the list was cleared since
+        inline T operator [] (size_t i) const {
+            size_t j;
+            T* page = locate(i, j);
+            return page != nullptr ? untag(page)[j] : S;
+        }
+
+        inline const_iterator seek(size_t i) const {
+            if (i >= size()) return end();
+            size_t j;
+            T* page = locate(i, j);
+            if (page == nullptr) return end(); // cleared since
+            return const_iterator(untag(page) + j, page);
         }
 
         inline const_iterator begin() const {
-            return const_iterator((memory != nullptr && *memory != S) ? memory : nullptr);
-            return const_iterator((*memory == S) ? nullptr : memory);
+            return const_iterator(memory.load(std::memory_order_acquire));
         }
 
         inline const_iterator end() const {
             return const_iterator(nullptr);
         }
+
+        /**
+         * Call f(first, n) on the committed runs of the pages until it returns true, unsealed pages 
+         * are cut at their first uncommitted slot (sentinel frontier). Returns whether f stopped the scan.
+         * */
+        template<typename F>
+        bool scan(F f) const {
+            for (T* page = memory.load(std::memory_order_acquire); page != nullptr; page = *end_of(page)) {
+                T* mem = untag(page);
+                unsigned int n = capacity(page);
+                if (committed(page).load(std::memory_order_acquire) < n) n = (unsigned int)LockfreeScan::find(mem, n, S);
+                if (n > 0 && f((const T*)mem, n)) return true;
+            }
+            return false;
+        }
+
+        // number of elements equal to value (see LockfreeScan)
+        inline size_t count(T value) const {
+            return LockfreeScan::count(*this, value);
+        }
+
+        inline bool contains(T value) const {
+            return LockfreeScan::contains(*this, value);
+        }
+
+        // first element for which pred returns true
+        template<typename Predicate>
+        inline bool find_first(Predicate pred, T& value) const {
+            return LockfreeScan::find_first(*this, pred, value);
+        }
+
+        // append the elements in [lo, hi] to out, returns their number
+        inline size_t filter(T lo, T hi, std::vector<T>& out) const {
+            return LockfreeScan::filter(*this, lo, hi, out);
+        }
+
+        /**
+         * Deliver the elements appended since the last poll() with c (see LockfreeVector9::poll()).
+         * Cursors must not be held across clear(), which frees the pages they point to.
+         * */
+        template<typename F>
+        size_t poll(cursor& c, F f) const {
+            size_t n = 0;
+            if (c.page == nullptr) c.page = memory.load(std::memory_order_acquire);
+            if (c.page == nullptr) return 0; // empty
+            while (true) {
+                T* mem = untag(c.page);
+                for (unsigned int cap = capacity(c.page); c.index < cap; c.index++) {
+                    T value = mem[c.index];
+                    if (value == S) return n; // not committed yet
+                    f(value);
+                    n++;
+                }
+                T* next = *end_of(c.page);
+                if (next == nullptr) return n;
+                c.page = next;
+                c.index = 0;
+            }
+        }
+
+        // poll(c) would deliver at least one element, follows the chain past full pages
+        inline bool has_new(const cursor& c) const {
+            T* page = c.page != nullptr ? c.page : memory.load(std::memory_order_acquire);
+            unsigned int i = c.page != nullptr ? c.index : 0;
+            while (page != nullptr) {
+                if (i < capacity(page)) return untag(page)[i] != S;
+                page = *end_of(page);
+                i = 0;
+            }
+            return false;
+        }
+
+        // block until poll(c) has new elements or the timeout expires (see LockfreeVector9::wait_for_new())
+        template<class Rep, class Period>
+        bool wait_for_new(const cursor& c, std::chrono::duration<Rep, Period> timeout) const {
+            return LockfreeWait::wait(this, waiters(), [this, &c] { return has_new(c); }, std::chrono::duration_cast<std::chrono::nanoseconds>(timeout));
+        }
     };
 
-    LockfreeVector9* map; 
-    const unsigned int size_;
+    /**
+     * Key directory, segment s holds the headers of F * 2^s keys and is allocated on first use. 
+     * Segments never move, so headers keep their address while the directory grows.
+     * */
+    static constexpr unsigned int SEGMENTS = 32;
+    std::atomic<LockfreeVector9*> segments[SEGMENTS];
+    const unsigned int F; // keys in the first segment
+    std::atomic<unsigned int> size_;
+
+    LockfreeEpoch domain; // delays freeing of cleared pages
+    mutable LockfreeStats stats;
+
+    typedef LockfreeSet<T, S> Filter;
+    std::atomic<Filter*> filters[SEGMENTS]; // parallel to segments, allocated on first push_unique()
 
     LockfreeMap3(LockfreeMap3 const&) = delete;
     void operator=(LockfreeMap3 const&) = delete;
     LockfreeMap3(LockfreeMap3&& other) = delete;
 
+    inline unsigned int segment_of(size_t key, size_t& offset) const {
+        unsigned int s = 63 - __builtin_clzll((unsigned long long)(key / F + 1));
+        offset = key - (size_t)F * ((1ull << s) - 1);
+        return s;
+    }
+
+    LockfreeVector9* segment(unsigned int s) {
+        LockfreeVector9* seg = segments[s].load(std::memory_order_acquire);
+        if (seg == nullptr) { // concurrent allocations of the same segment are resolved by CAS
+            LockfreeVector9* fresh = new LockfreeVector9[(size_t)F << s];
+            if (segments[s].compare_exchange_strong(seg, fresh, std::memory_order_acq_rel)) {
+                stats.add(LockfreeStats::GROWS);
+                seg = fresh;
+            }
+            else {
+                stats.add(LockfreeStats::CAS_FAILURES);
+                delete[] fresh;
+            }
+        }
+        return seg;
+    }
+
 public:
-    LockfreeMap3(unsigned int n) : size_(n) {
-        map = new LockfreeVector9[n];
+    LockfreeMap3(unsigned int n = 64) : F(std::max(n, 1u)), size_(n) {
+        static_assert(sizeof(LockfreeVector9) == 64, "key header exceeds a cache line");
+        for (unsigned int s = 0; s < SEGMENTS; s++) segments[s].store(nullptr, std::memory_order_relaxed);
+        for (unsigned int s = 0; s < SEGMENTS; s++) filters[s].store(nullptr, std::memory_order_relaxed);
+        segment(0);
     }
 
     ~LockfreeMap3() { 
-        delete[] map;
+        domain.drain();
+        for (unsigned int s = 0; s < SEGMENTS; s++) {
+            delete[] segments[s].load(std::memory_order_relaxed);
+            delete[] filters[s].load(std::memory_order_relaxed);
+        }
     }
 
+    // number of keys, grows with reserve() and with accesses to larger keys
     unsigned int size() const {
-        return size_;
+        return size_.load(std::memory_order_acquire);
     }
 
+    // make keys below n available, segments are allocated before size() announces them
+    void reserve(unsigned int n) {
+        if (n == 0) return;
+        size_t offset;
+        unsigned int last = segment_of(n - 1, offset);
+        for (unsigned int s = 0; s <= last; s++) segment(s);
+        unsigned int cur = size_.load(std::memory_order_relaxed);
+        while (cur < n && !size_.compare_exchange_weak(cur, n, std::memory_order_release, std::memory_order_relaxed)) {
+            stats.add(LockfreeStats::CAS_FAILURES);
+        }
+    }
+
+    void push(T key, T value) {
+        (*this)[key].push(value, &stats);
+    }
+
+    template<typename Iterator>
+    void push(T key, Iterator first, Iterator last) {
+        (*this)[key].push(first, last, &stats);
+    }
+
+    // contention and retry counters of the map and of pushes and clears through it (see LockfreeStats)
+    inline LockfreeStats& statistics() const {
+        return stats;
+    }
+
+    // readers that may run concurrently with clear() hold a guard while iterating
+    inline LockfreeEpoch::guard protect() {
+        return LockfreeEpoch::guard(domain);
+    }
+
+    // block until the list of key has elements behind c or the timeout expires
+    template<class Rep, class Period>
+    bool wait_for_new(T key, const cursor& c, std::chrono::duration<Rep, Period> timeout) {
+        return (*this)[key].wait_for_new(c, timeout);
+    }
+
+    /**
+     * Push value unless push_unique() added it to the list of key before, returns whether it was pushed.
+     * Of concurrent calls with the same value exactly one succeeds, values added by push() are not checked. 
+     * */
+    bool push_unique(T key, T value) {
+        LockfreeVector9& header = (*this)[key];
+        size_t offset;
+        unsigned int s = segment_of((size_t)key, offset);
+        Filter* f = filters[s].load(std::memory_order_acquire);
+        if (f == nullptr) { // concurrent allocations are resolved by CAS
+            Filter* fresh = new Filter[(size_t)F << s];
+            if (filters[s].compare_exchange_strong(f, fresh, std::memory_order_acq_rel)) f = fresh;
+            else delete[] fresh;
+        }
+        if (!f[offset].insert(value)) return false;
+        header.push(value, &stats);
+        return true;
+    }
+
+    /**
+     * Empty the list of key, its pages are freed (see LockfreeVector9::clear()).
+     * The values are forgotten by push_unique(), calls overlapping clear() may be checked against either list.
+     * */
+    void clear(T key) {
+        (*this)[key].clear(domain, &stats);
+        size_t offset;
+        Filter* f = filters[segment_of((size_t)key, offset)].load(std::memory_order_acquire);
+        if (f != nullptr) {
+            void* tables = f[offset].detach();
+            if (tables != nullptr) domain.retire(tables, Filter::reclaim);
+        }
+    }
+
+    // header of key, keys from size() on are added
     LockfreeVector9& operator [] (T key) {
-        return map[key];
+        size_t offset;
+        unsigned int s = segment_of((size_t)key, offset);
+        LockfreeVector9* seg = segments[s].load(std::memory_order_acquire);
+        if (seg == nullptr || (unsigned int)key >= size_.load(std::memory_order_relaxed)) {
+            reserve((unsigned int)key + 1);
+            seg = segments[s].load(std::memory_order_acquire);
+        }
+        return seg[offset];
+    }
+
+    // splittable range of the keys (see LockfreeParallel), e.g. for tbb::parallel_for() or std::for_each(std::execution::par, ...)
+    inline LockfreeParallel::index_range<unsigned int> keys(size_t grain = 1) const {
+        return LockfreeParallel::index_range<unsigned int>(0, size(), grain);
+    }
+
+    // call f(key, value) on the elements of all keys with the keys spread over threads
+    template<typename F>
+    void parallel_for_each(F f, unsigned int threads = LockfreeParallel::concurrency()) {
+        LockfreeParallel::for_each(keys(), [this, &f] (const LockfreeParallel::index_range<unsigned int>& range) { 
+            for (unsigned int key : range) for (T value : (*this)[key]) f((T)key, value); 
+        }, threads);
+    }
+
+    // join of acc = f(acc, key, value) over the elements per key range, init is the identity of join
+    template<typename V, typename F, typename Join>
+    V parallel_reduce(V init, F f, Join join, unsigned int threads = LockfreeParallel::concurrency()) {
+        return LockfreeParallel::reduce(keys(), init, [this, &f] (const LockfreeParallel::index_range<unsigned int>& range, V acc) { 
+            for (unsigned int key : range) for (T value : (*this)[key]) acc = f(acc, (T)key, value); 
+            return acc;
+        }, join, threads);
     }
 
 };
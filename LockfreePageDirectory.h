@@ -0,0 +1,158 @@
+/*************************************************************************************************
+LockfreePageDirectory -- Copyright (c) 2020, Markus Iser, KIT - Karlsruhe Institute of Technology
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **************************************************************************************************/
+
+#ifndef Lockfree_PageDirectory
+#define Lockfree_PageDirectory
+
+#include <cstdlib>
+#include <cassert>
+#include <cstdint>
+#include <atomic>
+
+/**
+ * Append-only table of page pointers for O(1) access to page k of a page chain
+ * T is the content type of the pages
+ * Pages are appended by a single writer at a time (the thread doing the page switch),
+ * readers are lock-free. Tables double on growth, outgrown tables are kept until destruction 
+ * as readers might still use them, which costs at most the size of the final table.
+ * A second writer can replace() pages concurrently with the appending one: entries are tagged 
+ * (lowest bit) when they are moved to the grown table, so that replace() follows them there.
+ * */
+template<typename T>
+class LockfreePageDirectory {
+    struct Table {
+        Table* prev; // outgrown table
+        std::atomic<Table*> next; // grown table, set before entries are moved
+        unsigned int capacity;
+        std::atomic<unsigned int> count;
+        std::atomic<uintptr_t> pages[1]; // page pointers, tagged if moved to next
+    };
+
+    std::atomic<Table*> table;
+
+    static inline T* get(Table* t, unsigned int k) {
+        return (T*)(t->pages[k].load(std::memory_order_acquire) & ~(uintptr_t)1);
+    }
+
+    static Table* new_table(Table* prev, unsigned int capacity) {
+        Table* t = (Table*)std::malloc(sizeof(Table) + (capacity - 1) * sizeof(T*));
+        t->prev = prev;
+        t->next.store(nullptr, std::memory_order_relaxed);
+        t->capacity = capacity;
+        t->count.store(0, std::memory_order_relaxed);
+        for (unsigned int k = 0; k < capacity; k++) t->pages[k].store(0, std::memory_order_relaxed);
+        return t;
+    }
+
+    LockfreePageDirectory(LockfreePageDirectory const&) = delete;
+    void operator=(LockfreePageDirectory const&) = delete;
+    LockfreePageDirectory(LockfreePageDirectory&& other) = delete;
+
+public:
+    LockfreePageDirectory() : table(nullptr) { }
+
+    ~LockfreePageDirectory() {
+        Table* t = table.load(std::memory_order_relaxed);
+        while (t != nullptr) {
+            Table* prev = t->prev;
+            free(t);
+            t = prev;
+        }
+    }
+
+    void append(T* page) {
+        Table* t = table.load(std::memory_order_relaxed);
+        unsigned int c = t != nullptr ? t->count.load(std::memory_order_relaxed) : 0;
+        if (t == nullptr || c == t->capacity) {
+            Table* fresh = new_table(t, t != nullptr ? 2 * t->capacity : 4);
+            if (t != nullptr) t->next.store(fresh, std::memory_order_release);
+            for (unsigned int k = 0; k < c; k++) {
+                uintptr_t entry = t->pages[k].fetch_or(1, std::memory_order_acq_rel);
+                fresh->pages[k].store(entry, std::memory_order_release);
+            }
+            fresh->pages[c].store((uintptr_t)page, std::memory_order_relaxed);
+            fresh->count.store(c + 1, std::memory_order_relaxed);
+            table.store(fresh, std::memory_order_release);
+        } 
+        else {
+            t->pages[c].store((uintptr_t)page, std::memory_order_relaxed);
+            t->count.store(c + 1, std::memory_order_release);
+        }
+    }
+
+    /**
+     * Replace page k (not the last one) by fresh, expects that only one thread replaces pages
+     * Readers might still see the old page until the replacing thread retires it
+     * */
+    void replace(unsigned int k, T* page, T* fresh) {
+        Table* t = table.load(std::memory_order_acquire);
+        while (true) {
+            uintptr_t entry = (uintptr_t)page;
+            if (t->pages[k].compare_exchange_strong(entry, (uintptr_t)fresh, std::memory_order_acq_rel)) return;
+            assert(entry == ((uintptr_t)page | 1)); 
+            t = t->next.load(std::memory_order_acquire); // follow the moved entry
+            while (t->pages[k].load(std::memory_order_acquire) == 0) { } // busy-loop until it arrived
+        }
+    }
+
+    /**
+     * Empty the directory, e.g., when its page chain is detached
+     * Tables are handed to retire(void*) as readers might still use them
+     * */
+    template<typename Retire>
+    void clear(Retire retire) {
+        Table* t = table.exchange(nullptr, std::memory_order_acq_rel);
+        while (t != nullptr) {
+            Table* prev = t->prev;
+            retire((void*)t);
+            t = prev;
+        }
+    }
+
+    inline unsigned int size() const {
+        Table* t = table.load(std::memory_order_acquire);
+        return t != nullptr ? t->count.load(std::memory_order_acquire) : 0;
+    }
+
+    // last page, or nullptr if empty
+    inline T* back() const {
+        Table* t = table.load(std::memory_order_acquire);
+        if (t == nullptr) return nullptr;
+        unsigned int c = t->count.load(std::memory_order_acquire);
+        return c > 0 ? get(t, c-1) : nullptr;
+    }
+
+    // number of pages if page is the last one, 0 otherwise (e.g., during a page switch)
+    inline unsigned int size_if_back(T* page) const {
+        Table* t = table.load(std::memory_order_acquire);
+        if (t == nullptr) return 0;
+        unsigned int c = t->count.load(std::memory_order_acquire);
+        return (c > 0 && get(t, c-1) == page) ? c : 0;
+    }
+
+    // page k, or nullptr if k >= size(), e.g., after clear()
+    inline T* operator [] (unsigned int k) const {
+        Table* t = table.load(std::memory_order_acquire);
+        if (t == nullptr || k >= t->count.load(std::memory_order_acquire)) return nullptr;
+        return get(t, k);
+    }
+
+};
+
+#endif
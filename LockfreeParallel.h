@@ -0,0 +1,156 @@
+/*************************************************************************************************
+LockfreeParallel -- Copyright (c) 2020, Markus Iser, KIT - Karlsruhe Institute of Technology
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **************************************************************************************************/
+
+#ifndef Lockfree_Parallel
+#define Lockfree_Parallel
+
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+
+/**
+ * Parallel sweeps over splittable ranges
+ * 
+ * A splittable range is copyable and has empty(), is_divisible() and a splitting constructor 
+ * Range(Range& r, Split) that moves the upper half of r into the new range, the Split tag is a 
+ * template parameter, so tbb::parallel_for() and tbb::parallel_reduce() can split the ranges as well.
+ * for_each() and reduce() halve the range into up to 4 pieces per thread, which the threads take in turn.
+ * */
+class LockfreeParallel {
+    template<typename Range>
+    static std::vector<Range> pieces(const Range& range, unsigned int threads) {
+        std::vector<Range> pieces { range };
+        size_t target = 4 * (size_t)threads;
+        while (pieces.size() < target) { // halve every piece once per round
+            size_t n = pieces.size();
+            for (size_t i = 0; i < n && pieces.size() < target; i++) {
+                if (pieces[i].is_divisible()) {
+                    Range upper(pieces[i], split());
+                    pieces.push_back(upper);
+                }
+            }
+            if (pieces.size() == n) break;
+        }
+        return pieces;
+    }
+
+public:
+    struct split { };
+
+    static inline unsigned int concurrency() {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    /**
+     * Range of the indices [first, last) (e.g. keys of a map), split into halves of at least grain indices
+     * */
+    template<typename K = unsigned int>
+    class index_range {
+        K first_, last_;
+        size_t grain;
+
+    public:
+        class iterator {
+            K k;
+
+        public:
+            typedef std::random_access_iterator_tag iterator_category;
+            typedef K value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const K* pointer;
+            typedef K reference;
+
+            iterator(K k_ = 0) : k(k_) { }
+
+            inline K operator * () const { return k; }
+            inline K operator [] (difference_type n) const { return k + n; }
+            inline iterator& operator ++ () { ++k; return *this; }
+            inline iterator operator ++ (int) { return iterator(k++); }
+            inline iterator& operator -- () { --k; return *this; }
+            inline iterator operator -- (int) { return iterator(k--); }
+            inline iterator& operator += (difference_type n) { k += n; return *this; }
+            inline iterator& operator -= (difference_type n) { k -= n; return *this; }
+            inline iterator operator + (difference_type n) const { return iterator(k + n); }
+            inline iterator operator - (difference_type n) const { return iterator(k - n); }
+            inline friend iterator operator + (difference_type n, const iterator& it) { return it + n; }
+            inline difference_type operator - (const iterator& other) const { return (difference_type)k - (difference_type)other.k; }
+            inline bool operator == (const iterator& other) const { return k == other.k; }
+            inline bool operator != (const iterator& other) const { return k != other.k; }
+            inline bool operator < (const iterator& other) const { return k < other.k; }
+            inline bool operator > (const iterator& other) const { return k > other.k; }
+            inline bool operator <= (const iterator& other) const { return k <= other.k; }
+            inline bool operator >= (const iterator& other) const { return k >= other.k; }
+        };
+
+        index_range(K first, K last, size_t grain_ = 1) : first_(first), last_(last), grain(std::max<size_t>(grain_, 1)) { }
+
+        template<typename Split>
+        index_range(index_range& other, Split) : first_(other.first_ + (other.last_ - other.first_) / 2), last_(other.last_), grain(other.grain) {
+            other.last_ = first_;
+        }
+
+        inline bool empty() const { return first_ >= last_; }
+        inline bool is_divisible() const { return (size_t)(last_ - first_) > grain; }
+        inline size_t size() const { return empty() ? 0 : last_ - first_; }
+        inline iterator begin() const { return iterator(first_); }
+        inline iterator end() const { return iterator(std::max(first_, last_)); }
+    };
+
+    // call f(piece) on pieces of range in parallel
+    template<typename Range, typename F>
+    static void for_each(const Range& range, F f, unsigned int threads = concurrency()) {
+        std::vector<Range> work = pieces(range, threads);
+        std::atomic<size_t> next(0);
+        auto run = [&work, &next, &f] {
+            for (size_t i = next.fetch_add(1); i < work.size(); i = next.fetch_add(1)) {
+                if (!work[i].empty()) f(work[i]);
+            }
+        };
+        std::vector<std::thread> pool { };
+        for (unsigned int t = 1; t < std::min<size_t>(threads, work.size()); t++) pool.emplace_back(run);
+        run();
+        for (std::thread& thread : pool) thread.join();
+    }
+
+    // join of f(piece, init) over the pieces of range, init is the identity of the associative join
+    template<typename Range, typename V, typename F, typename Join>
+    static V reduce(const Range& range, V init, F f, Join join, unsigned int threads = concurrency()) {
+        std::vector<Range> work = pieces(range, threads);
+        std::vector<V> results(work.size(), init);
+        std::atomic<size_t> next(0);
+        auto run = [&work, &results, &next, &f] {
+            for (size_t i = next.fetch_add(1); i < work.size(); i = next.fetch_add(1)) {
+                if (!work[i].empty()) results[i] = f(work[i], results[i]);
+            }
+        };
+        std::vector<std::thread> pool { };
+        for (unsigned int t = 1; t < std::min<size_t>(threads, work.size()); t++) pool.emplace_back(run);
+        run();
+        for (std::thread& thread : pool) thread.join();
+        V value = init;
+        for (const V& result : results) value = join(value, result);
+        return value;
+    }
+
+};
+
+#endif
@@ -0,0 +1,292 @@
+/*************************************************************************************************
+LockfreeScan -- Copyright (c) 2020, Markus Iser, KIT - Karlsruhe Institute of Technology
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **************************************************************************************************/
+
+#ifndef Lockfree_Scan
+#define Lockfree_Scan
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LOCKFREE_SCAN_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * Scan kernels over runs of integral elements, e.g. the pages of the vectors
+ * 
+ * 4 and 8 byte elements are compared 8 resp. 4 at a time with AVX2 if the CPU supports it (checked once), 
+ * 4 byte elements 4 at a time with SSE2 otherwise, all other cases and the tails of runs are scanned by scalar loops.
+ * Unsigned elements are biased by the sign bit for the ordered comparisons of filter().
+ * The reductions over ranges run the kernels on the runs a range hands out by scan(f) (see LockfreeVector9::scan()), 
+ * so the lists of the vectors and maps share them.
+ * */
+class LockfreeScan {
+#ifdef LOCKFREE_SCAN_X86
+    static inline bool avx2() {
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+    }
+
+    template<typename T>
+    static inline long long bias() {
+        return std::is_signed<T>::value ? 0 : (long long)(1ull << (8 * sizeof(T) - 1));
+    }
+
+    __attribute__((target("avx2")))
+    static size_t count_avx2(const uint32_t* p, size_t n, uint32_t value) {
+        __m256i x = _mm256_set1_epi32((int)value);
+        __m256i acc = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) { // matches are -1, subtracting them counts per lane
+            acc = _mm256_sub_epi32(acc, _mm256_cmpeq_epi32(x, _mm256_loadu_si256((const __m256i*)(p + i))));
+        }
+        uint32_t lanes[8];
+        _mm256_storeu_si256((__m256i*)lanes, acc);
+        size_t c = 0;
+        for (unsigned int j = 0; j < 8; j++) c += lanes[j];
+        for (; i < n; i++) c += (p[i] == value);
+        return c;
+    }
+
+    __attribute__((target("avx2")))
+    static size_t count_avx2(const uint64_t* p, size_t n, uint64_t value) {
+        __m256i x = _mm256_set1_epi64x((long long)value);
+        __m256i acc = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            acc = _mm256_sub_epi64(acc, _mm256_cmpeq_epi64(x, _mm256_loadu_si256((const __m256i*)(p + i))));
+        }
+        uint64_t lanes[4];
+        _mm256_storeu_si256((__m256i*)lanes, acc);
+        size_t c = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        for (; i < n; i++) c += (p[i] == value);
+        return c;
+    }
+
+    static size_t count_sse2(const uint32_t* p, size_t n, uint32_t value) {
+        __m128i x = _mm_set1_epi32((int)value);
+        __m128i acc = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            acc = _mm_sub_epi32(acc, _mm_cmpeq_epi32(x, _mm_loadu_si128((const __m128i*)(p + i))));
+        }
+        uint32_t lanes[4];
+        _mm_storeu_si128((__m128i*)lanes, acc);
+        size_t c = (size_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        for (; i < n; i++) c += (p[i] == value);
+        return c;
+    }
+
+    __attribute__((target("avx2")))
+    static size_t find_avx2(const uint32_t* p, size_t n, uint32_t value) {
+        __m256i x = _mm256_set1_epi32((int)value);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i eq = _mm256_cmpeq_epi32(x, _mm256_loadu_si256((const __m256i*)(p + i)));
+            unsigned int mask = _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+            if (mask != 0) return i + __builtin_ctz(mask);
+        }
+        for (; i < n; i++) if (p[i] == value) return i;
+        return n;
+    }
+
+    __attribute__((target("avx2")))
+    static size_t find_avx2(const uint64_t* p, size_t n, uint64_t value) {
+        __m256i x = _mm256_set1_epi64x((long long)value);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256i eq = _mm256_cmpeq_epi64(x, _mm256_loadu_si256((const __m256i*)(p + i)));
+            unsigned int mask = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+            if (mask != 0) return i + __builtin_ctz(mask);
+        }
+        for (; i < n; i++) if (p[i] == value) return i;
+        return n;
+    }
+
+    static size_t find_sse2(const uint32_t* p, size_t n, uint32_t value) {
+        __m128i x = _mm_set1_epi32((int)value);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i eq = _mm_cmpeq_epi32(x, _mm_loadu_si128((const __m128i*)(p + i)));
+            unsigned int mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+            if (mask != 0) return i + __builtin_ctz(mask);
+        }
+        for (; i < n; i++) if (p[i] == value) return i;
+        return n;
+    }
+
+    // lo, hi and the elements are biased to signed order
+    __attribute__((target("avx2")))
+    static size_t filter_avx2(const uint32_t* p, size_t n, int32_t lo, int32_t hi, int32_t b, uint32_t* out) {
+        __m256i vb = _mm256_set1_epi32(b), vlo = _mm256_set1_epi32(lo), vhi = _mm256_set1_epi32(hi);
+        size_t k = 0, i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i y = _mm256_xor_si256(vb, _mm256_loadu_si256((const __m256i*)(p + i)));
+            __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(vlo, y), _mm256_cmpgt_epi32(y, vhi));
+            unsigned int mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(outside)) & 0xff;
+            for (; mask != 0; mask &= mask - 1) out[k++] = p[i + __builtin_ctz(mask)];
+        }
+        for (; i < n; i++) {
+            int32_t y = (int32_t)(p[i] ^ (uint32_t)b);
+            if (lo <= y && y <= hi) out[k++] = p[i];
+        }
+        return k;
+    }
+
+    __attribute__((target("avx2")))
+    static size_t filter_avx2(const uint64_t* p, size_t n, int64_t lo, int64_t hi, int64_t b, uint64_t* out) {
+        __m256i vb = _mm256_set1_epi64x(b), vlo = _mm256_set1_epi64x(lo), vhi = _mm256_set1_epi64x(hi);
+        size_t k = 0, i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256i y = _mm256_xor_si256(vb, _mm256_loadu_si256((const __m256i*)(p + i)));
+            __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi64(vlo, y), _mm256_cmpgt_epi64(y, vhi));
+            unsigned int mask = ~_mm256_movemask_pd(_mm256_castsi256_pd(outside)) & 0xf;
+            for (; mask != 0; mask &= mask - 1) out[k++] = p[i + __builtin_ctz(mask)];
+        }
+        for (; i < n; i++) {
+            int64_t y = (int64_t)(p[i] ^ (uint64_t)b);
+            if (lo <= y && y <= hi) out[k++] = p[i];
+        }
+        return k;
+    }
+
+    static size_t filter_sse2(const uint32_t* p, size_t n, int32_t lo, int32_t hi, int32_t b, uint32_t* out) {
+        __m128i vb = _mm_set1_epi32(b), vlo = _mm_set1_epi32(lo), vhi = _mm_set1_epi32(hi);
+        size_t k = 0, i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i y = _mm_xor_si128(vb, _mm_loadu_si128((const __m128i*)(p + i)));
+            __m128i outside = _mm_or_si128(_mm_cmplt_epi32(y, vlo), _mm_cmpgt_epi32(y, vhi));
+            unsigned int mask = ~_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xf;
+            for (; mask != 0; mask &= mask - 1) out[k++] = p[i + __builtin_ctz(mask)];
+        }
+        for (; i < n; i++) {
+            int32_t y = (int32_t)(p[i] ^ (uint32_t)b);
+            if (lo <= y && y <= hi) out[k++] = p[i];
+        }
+        return k;
+    }
+#endif
+
+    template<typename T>
+    using lanes = typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type;
+
+    template<typename T>
+    static constexpr bool vectorized() {
+        return std::is_integral<T>::value && (sizeof(T) == 4 || sizeof(T) == 8);
+    }
+
+public:
+    // number of elements of p[0, n) equal to value
+    template<typename T>
+    static size_t count(const T* p, size_t n, T value) {
+#ifdef LOCKFREE_SCAN_X86
+        if constexpr (vectorized<T>()) {
+            typedef lanes<T> L;
+            if (avx2()) return count_avx2((const L*)p, n, (L)value);
+            if constexpr (sizeof(T) == 4) return count_sse2((const L*)p, n, (L)value);
+        }
+#endif
+        size_t c = 0;
+        for (size_t i = 0; i < n; i++) c += (p[i] == value);
+        return c;
+    }
+
+    // index of the first element of p[0, n) equal to value, n if there is none
+    template<typename T>
+    static size_t find(const T* p, size_t n, T value) {
+#ifdef LOCKFREE_SCAN_X86
+        if constexpr (vectorized<T>()) {
+            typedef lanes<T> L;
+            if (avx2()) return find_avx2((const L*)p, n, (L)value);
+            if constexpr (sizeof(T) == 4) return find_sse2((const L*)p, n, (L)value);
+        }
+#endif
+        for (size_t i = 0; i < n; i++) if (p[i] == value) return i;
+        return n;
+    }
+
+    template<typename T>
+    static inline bool contains(const T* p, size_t n, T value) {
+        return find(p, n, value) < n;
+    }
+
+    // copies the elements of p[0, n) in [lo, hi] to out (room for n elements), returns their number
+    template<typename T>
+    static size_t filter(const T* p, size_t n, T lo, T hi, T* out) {
+#ifdef LOCKFREE_SCAN_X86
+        if constexpr (vectorized<T>()) {
+            typedef lanes<T> L;
+            typedef typename std::make_signed<L>::type I;
+            I b = (I)bias<T>();
+            I l = (I)((L)lo ^ (L)b), h = (I)((L)hi ^ (L)b);
+            if (avx2()) return filter_avx2((const L*)p, n, l, h, b, (L*)out);
+            if constexpr (sizeof(T) == 4) return filter_sse2((const L*)p, n, l, h, b, (L*)out);
+        }
+#endif
+        size_t k = 0;
+        for (size_t i = 0; i < n; i++) if (lo <= p[i] && p[i] <= hi) out[k++] = p[i];
+        return k;
+    }
+
+    // number of elements of range equal to value
+    template<typename R, typename T>
+    static size_t count(const R& range, T value) {
+        size_t c = 0;
+        range.scan([&c, value] (const T* p, unsigned int n) { c += count(p, n, value); return false; });
+        return c;
+    }
+
+    template<typename R, typename T>
+    static bool contains(const R& range, T value) {
+        return range.scan([value] (const T* p, unsigned int n) { return contains(p, n, value); });
+    }
+
+    // first element of range for which pred returns true
+    template<typename R, typename T, typename Predicate>
+    static bool find_first(const R& range, Predicate pred, T& value) {
+        return range.scan([&pred, &value] (const T* p, unsigned int n) {
+            for (unsigned int j = 0; j < n; j++) {
+                if (pred(p[j])) {
+                    value = p[j];
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+
+    // append the elements of range in [lo, hi] to out, returns their number
+    template<typename R, typename T>
+    static size_t filter(const R& range, T lo, T hi, std::vector<T>& out) {
+        size_t k = out.size();
+        range.scan([&out, lo, hi] (const T* p, unsigned int n) { 
+            size_t m = out.size();
+            out.resize(m + n);
+            out.resize(m + filter(p, n, lo, hi, out.data() + m));
+            return false; 
+        });
+        return out.size() - k;
+    }
+
+};
+
+#endif
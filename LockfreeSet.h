@@ -0,0 +1,135 @@
+/*************************************************************************************************
+LockfreeSet -- Copyright (c) 2020, Markus Iser, KIT - Karlsruhe Institute of Technology
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **************************************************************************************************/
+
+#ifndef Lockfree_Set
+#define Lockfree_Set
+
+#include <cstdlib>
+#include <cstdint>
+#include <cassert>
+#include <atomic>
+#include <new>
+#include <algorithm>
+
+/**
+ * Insert-only set of values, e.g., the members of one list of a map
+ * T is the content type and must be integral
+ * E empty value, must not be inserted
+ * 
+ * Values are claimed by CAS within a window of W slots of their hash. Once a window is full the value 
+ * goes to the next table, which has twice the slots, so the set grows with its contents starting 
+ * from C slots. Values never move: inserts of the same value follow the same probe sequence 
+ * and meet in the same slot, so exactly one of them succeeds.
+ * The object is a single pointer, the tables are allocated on first insert.
+ * */
+template<typename T = uint32_t, T E = 0>
+class LockfreeSet {
+    struct Table {
+        std::atomic<Table*> next;
+        unsigned int capacity;
+        std::atomic<T> slots[1];
+    };
+
+    static constexpr unsigned int C = 8; // slots in the first table
+    static constexpr unsigned int W = 16; // probe window
+
+    std::atomic<Table*> head;
+
+    LockfreeSet(LockfreeSet const&) = delete;
+    void operator=(LockfreeSet const&) = delete;
+    LockfreeSet(LockfreeSet&& other) = delete;
+
+    static inline uint64_t hash(T value) { // splitmix64 finalizer
+        uint64_t h = (uint64_t)value;
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+        return h ^ (h >> 31);
+    }
+
+    // table behind link, allocated if missing (concurrent allocations are resolved by CAS)
+    static Table* table(std::atomic<Table*>& link, unsigned int capacity) {
+        Table* t = link.load(std::memory_order_acquire);
+        if (t == nullptr) {
+            Table* fresh = (Table*)std::malloc(sizeof(Table) + (capacity - 1) * sizeof(std::atomic<T>));
+            new (&fresh->next) std::atomic<Table*>(nullptr);
+            fresh->capacity = capacity;
+            for (unsigned int j = 0; j < capacity; j++) new (&fresh->slots[j]) std::atomic<T>(E);
+            if (link.compare_exchange_strong(t, fresh, std::memory_order_acq_rel)) t = fresh;
+            else free(fresh);
+        }
+        return t;
+    }
+
+public:
+    LockfreeSet() : head(nullptr) { }
+
+    ~LockfreeSet() {
+        reclaim(head.load(std::memory_order_relaxed));
+    }
+
+    // returns false if value is in the set already
+    bool insert(T value) {
+        assert(value != E);
+        uint64_t h = hash(value);
+        std::atomic<Table*>* link = &head;
+        for (unsigned int capacity = C; ; capacity *= 2) {
+            Table* t = table(*link, capacity);
+            unsigned int window = std::min(W, capacity);
+            for (unsigned int j = 0; j < window; j++) {
+                std::atomic<T>& slot = t->slots[(h + j) & (capacity - 1)];
+                T v = slot.load(std::memory_order_acquire);
+                if (v == E && slot.compare_exchange_strong(v, value, std::memory_order_acq_rel)) return true;
+                if (v == value) return false;
+            }
+            link = &t->next;
+        }
+    }
+
+    bool contains(T value) const {
+        uint64_t h = hash(value);
+        for (Table* t = head.load(std::memory_order_acquire); t != nullptr; t = t->next.load(std::memory_order_acquire)) {
+            unsigned int window = std::min(W, t->capacity);
+            for (unsigned int j = 0; j < window; j++) {
+                T v = t->slots[(h + j) & (t->capacity - 1)].load(std::memory_order_acquire);
+                if (v == value) return true;
+                if (v == E) return false;
+            }
+        }
+        return false;
+    }
+
+    // empty the set, the returned tables might still be in use and are freed by reclaim()
+    inline void* detach() {
+        return head.exchange(nullptr, std::memory_order_acq_rel);
+    }
+
+    // free detached tables, can serve as reclaim function of LockfreeEpoch::retire()
+    static bool reclaim(void* ptr) {
+        Table* t = (Table*)ptr;
+        while (t != nullptr) {
+            Table* next = t->next.load(std::memory_order_relaxed);
+            free(t);
+            t = next;
+        }
+        return true;
+    }
+
+};
+
+#endif
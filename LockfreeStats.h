@@ -0,0 +1,106 @@
+/*************************************************************************************************
+LockfreeStats -- Copyright (c) 2020, Markus Iser, KIT - Karlsruhe Institute of Technology
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **************************************************************************************************/
+
+#ifndef Lockfree_Stats
+#define Lockfree_Stats
+
+#include <cstdint>
+#include <atomic>
+#include <ostream>
+
+/**
+ * Contention and retry counters of one data structure instance
+ * 
+ * Compiled in with -DLOCKFREE_STATS, otherwise add() does nothing and snapshot() reads zeros.
+ * Counters are sharded: each thread increments the shard picked for it on first use (round robin), 
+ * which has its own cache line, so counting stays uncontended up to SHARDS threads and snapshot() 
+ * only loads. A snapshot merges the shards and is exact once the counting threads are done.
+ * */
+class LockfreeStats {
+public:
+    enum Counter { CAS_FAILURES, SPINS, PAGE_SWITCHES, GROWS, BYTES_COPIED, RECLAIM_WAITS, COUNTERS };
+
+    static constexpr const char* names[COUNTERS] = { "cas_failures", "spins", "page_switches", "grows", "bytes_copied", "reclaim_waits" };
+
+    struct Snapshot {
+        uint64_t counts[COUNTERS];
+
+        inline uint64_t operator [] (Counter c) const { return counts[c]; }
+    };
+
+#ifdef LOCKFREE_STATS
+private:
+    static constexpr unsigned int SHARDS = 16;
+
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> counts[COUNTERS];
+    };
+
+    Shard shards[SHARDS];
+
+    static inline unsigned int shard() {
+        static std::atomic<unsigned int> threads { 0 };
+        static thread_local unsigned int id = threads.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+        return id;
+    }
+
+    LockfreeStats(LockfreeStats const&) = delete;
+    void operator=(LockfreeStats const&) = delete;
+    LockfreeStats(LockfreeStats&& other) = delete;
+
+public:
+    LockfreeStats() { reset(); }
+
+    inline void add(Counter c, uint64_t n = 1) {
+        shards[shard()].counts[c].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    Snapshot snapshot() const {
+        Snapshot s { };
+        for (const Shard& shard : shards) {
+            for (unsigned int c = 0; c < COUNTERS; c++) s.counts[c] += shard.counts[c].load(std::memory_order_relaxed);
+        }
+        return s;
+    }
+
+    // counts of threads that add concurrently might survive
+    void reset() {
+        for (Shard& shard : shards) {
+            for (unsigned int c = 0; c < COUNTERS; c++) shard.counts[c].store(0, std::memory_order_relaxed);
+        }
+    }
+#else
+public:
+    inline void add(Counter, uint64_t = 1) { }
+
+    inline Snapshot snapshot() const { return Snapshot { }; }
+
+    inline void reset() { }
+#endif
+
+    // one CSV line per counter
+    void report(std::ostream& out) const {
+        Snapshot s = snapshot();
+        out << "counter,count" << std::endl;
+        for (unsigned int c = 0; c < COUNTERS; c++) out << names[c] << "," << s.counts[c] << std::endl;
+    }
+
+};
+
+#endif
@@ -147,7 +147,7 @@ private:
     LockfreeVector(LockfreeVector&& other) = delete;
 
 public:
-    LockfreeVector(uint32_t n) : cursor(OFFSET), memory(n) { }
+    LockfreeVector(uint32_t n) : memory(n), cursor(OFFSET) { }
 
     ~LockfreeVector() { }
 
@@ -0,0 +1,283 @@
+/*************************************************************************************************
+LockfreeVector -- Copyright (c) 2020, Markus Iser, KIT - Karlsruhe Institute of Technology
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **************************************************************************************************/
+
+#ifndef Lockfree_VECTOR10
+#define Lockfree_VECTOR10
+
+#include <cstdlib>
+#include <cstring> 
+#include <atomic>
+#include <memory>
+#include <new>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+
+#include "LockfreePageDirectory.h"
+#include "LockfreeStats.h"
+
+/**
+ * Paged vector like LockfreeVector9, but without sentinel element
+ * T is the content type and must be trivially copyable (any value can be stored)
+ * N elements per page
+ * B counter bits, assert B <= 16, N + threads < 2^B (see LockfreeVector9)
+ * 
+ * Publication is tracked by a per-page bitmap of ready slots: the writer copies the element and 
+ * then sets its ready bit. Iterators visit exactly the ready slots, i.e., they neither stop at 
+ * nor wait for slots claimed by slow writers. Full pages are walked word by word without checks.
+ * */
+template<typename T = uint32_t, unsigned int N = 1000, unsigned int B = 16>
+class LockfreeVector10 {
+    static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+
+    static const unsigned int W = (N + 63) / 64; // bitmap words per page
+
+    struct Page {
+        std::atomic<Page*> next;
+        std::atomic<uint64_t> ready[W];
+        T data[N];
+    };
+
+public:
+    class const_iterator {
+        Page* page;
+        unsigned int idx; // current slot
+        unsigned int word; // current bitmap word
+        uint64_t mask; // ready bits of the current word which are still to visit, including idx
+
+        inline void enter(unsigned int w) { 
+            // position at the first ready slot in word w or after
+            while (page != nullptr) {
+                for (word = w; word < W; word++) {
+                    mask = page->ready[word].load(std::memory_order_acquire);
+                    if (mask != 0) {
+                        idx = word * 64 + __builtin_ctzll(mask);
+                        return;
+                    }
+                }
+                page = page->next.load(std::memory_order_acquire);
+                w = 0;
+            }
+            idx = 0;
+        }
+
+    public:
+        const_iterator(Page* page_) : page(page_), idx(0), word(0), mask(0) { 
+            enter(0);
+        }
+
+        const_iterator(Page* page_, unsigned int i) : page(page_), idx(i), word(i / 64), mask(0) { 
+            mask = page->ready[word].load(std::memory_order_acquire) & (~0ULL << (i % 64));
+            if (mask != 0) idx = word * 64 + __builtin_ctzll(mask);
+            else enter(word + 1);
+        }
+
+        ~const_iterator() { }
+
+        inline const T& operator * () const { 
+            assert(page != nullptr);
+            return page->data[idx]; 
+        }
+
+        inline const_iterator& operator ++ () { 
+            mask &= mask - 1;
+            if (mask != 0) idx = word * 64 + __builtin_ctzll(mask);
+            else enter(word + 1);
+            return *this; 
+        }
+
+        inline bool operator != (const const_iterator& other) const {
+            return page != other.page || idx != other.idx;
+        }
+
+        inline bool operator == (const const_iterator& other) const {
+            return !(*this != other);
+        }
+    };
+    
+
+private:
+    Page* memory;
+    std::atomic<uintptr_t> pos;
+    LockfreePageDirectory<Page> directory;
+    mutable LockfreeStats stats;
+
+    static inline unsigned int get_index(uintptr_t pos) {
+        return pos & ((1 << B) - 1);
+    }
+
+    static inline Page* get_page(uintptr_t pos) {
+        return (Page*)(pos >> B);
+    }
+
+    // set ready bits of slots [i, i+k)
+    static inline void publish(Page* page, unsigned int i, unsigned int k) {
+        while (k > 0) {
+            unsigned int b = i % 64;
+            unsigned int n = std::min(k, 64 - b);
+            uint64_t bits = (n == 64) ? ~0ULL : (((1ULL << n) - 1) << b);
+            page->ready[i / 64].fetch_or(bits, std::memory_order_release);
+            i += n;
+            k -= n;
+        }
+    }
+
+    template<typename Iterator>
+    static inline Iterator copy_run(Iterator first, Page* page, unsigned int i, unsigned int k) {
+        for (unsigned int j = i; j < i + k; ++j, ++first) {
+            page->data[j] = *first;
+        }
+        if (k > 0) publish(page, i, k);
+        return first;
+    }
+
+    LockfreeVector10(LockfreeVector10 const&) = delete;
+    void operator=(LockfreeVector10 const&) = delete;
+    LockfreeVector10(LockfreeVector10&& other) = delete;
+
+    Page* new_page() {
+        Page* page = (Page*)std::malloc(sizeof(Page));
+        new (&page->next) std::atomic<Page*>(nullptr);
+        for (unsigned int w = 0; w < W; w++) new (&page->ready[w]) std::atomic<uint64_t>(0);
+        return page;
+    }
+
+public:
+    LockfreeVector10() {
+        memory = new_page();
+        directory.append(memory);
+        pos.store((uintptr_t)memory << B, std::memory_order_relaxed);
+    }
+
+    ~LockfreeVector10() { 
+        Page* page = memory;
+        while (page != nullptr) {
+            memory = page->next.load(std::memory_order_relaxed);
+            free(page);
+            page = memory;
+        }
+    }
+
+    void push(const T& value) {
+        while (true) {
+            uintptr_t cur = pos.load(std::memory_order_acquire);
+            unsigned int i = get_index(cur);
+            if (i <= N) { // block pos++ during realloc (busy-loop)
+                cur = pos.fetch_add(1, std::memory_order_acq_rel);
+                i = get_index(cur);
+                Page* page = get_page(cur);
+                if (i < N) { 
+                    page->data[i] = value;
+                    page->ready[i / 64].fetch_or(1ULL << (i % 64), std::memory_order_release);
+                    return;
+                }
+                else if (i == N) { // all smaller pos are allocated
+                    Page* fresh = new_page();
+                    directory.append(fresh);
+                    page->next.store(fresh, std::memory_order_release); //now readers know about the new page
+                    pos.store((uintptr_t)fresh << B, std::memory_order_release);
+                    stats.add(LockfreeStats::PAGE_SWITCHES);
+                } // loop to construct first element in new page
+                else stats.add(LockfreeStats::SPINS);
+            }
+            else stats.add(LockfreeStats::SPINS);
+        }
+    }
+
+    /**
+     * Push [first, last) with one CAS per page (see LockfreeVector9::push(first, last))
+     * */
+    template<typename Iterator>
+    void push(Iterator first, Iterator last) {
+        size_t rest = std::distance(first, last);
+        while (rest > 0) {
+            uintptr_t cur = pos.load(std::memory_order_acquire);
+            unsigned int i = get_index(cur);
+            if (i <= N) { // block pos+=k during realloc (busy-loop)
+                // the run that covers N claims one more slot, i.e. the page switch
+                unsigned int k = rest <= N - i ? (unsigned int)rest : N - i + 1;
+                Page* page = get_page(cur);
+                if (!pos.compare_exchange_weak(cur, cur + k, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                    stats.add(LockfreeStats::SPINS);
+                }
+                else if (i + k <= N) {
+                    first = copy_run(first, page, i, k);
+                    rest -= k;
+                }
+                else { // run covers N, i.e. all smaller pos are allocated
+                    first = copy_run(first, page, i, N - i);
+                    rest -= N - i;
+                    Page* fresh = new_page();
+                    directory.append(fresh);
+                    unsigned int m = (unsigned int)std::min<size_t>(rest, N);
+                    page->next.store(fresh, std::memory_order_release);
+                    pos.store(((uintptr_t)fresh << B) + m, std::memory_order_release);
+                    stats.add(LockfreeStats::PAGE_SWITCHES);
+                    first = copy_run(first, fresh, 0, m);
+                    rest -= m;
+                }
+            }
+            else stats.add(LockfreeStats::SPINS);
+        }
+    }
+
+    // number of claimed slots, see ready(i) for publication
+    inline size_t size() const {
+        while (true) {
+            uintptr_t cur = pos.load(std::memory_order_acquire);
+            unsigned int pages = directory.size();
+            if (directory[pages-1] == get_page(cur)) { // retry during page switch
+                return (size_t)(pages-1) * N + std::min(get_index(cur), N);
+            }
+        }
+    }
+
+    // expects i < size()
+    inline bool ready(size_t i) const {
+        unsigned int j = i % N;
+        return (directory[i / N]->ready[j / 64].load(std::memory_order_acquire) >> (j % 64)) & 1;
+    }
+
+    // expects ready(i)
+    inline const T& operator [] (size_t i) const {
+        return directory[i / N]->data[i % N];
+    }
+
+    // iterator starting at the first ready slot >= i
+    inline const_iterator seek(size_t i) const {
+        if (i >= size()) return end();
+        return const_iterator(directory[i / N], i % N);
+    }
+
+    // contention and retry counters (see LockfreeStats)
+    inline LockfreeStats& statistics() const {
+        return stats;
+    }
+
+    inline const_iterator begin() const {
+        return const_iterator(memory);
+    }
+
+    inline const_iterator end() const {
+        return const_iterator(nullptr);
+    }
+
+};
+
+#endif
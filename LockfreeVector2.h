@@ -176,7 +176,7 @@ private:
     LockfreeVector2(LockfreeVector2&& other) = delete;
 
 public:
-    LockfreeVector2(uint32_t n) : cursor(0), memory(n) { }
+    LockfreeVector2(uint32_t n) : memory(n), cursor(0) { }
 
     ~LockfreeVector2() { }
 
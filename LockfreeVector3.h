@@ -169,7 +169,7 @@ private:
     LockfreeVector3(LockfreeVector3&& other) = delete;
 
 public:
-    LockfreeVector3(uint32_t n) : cursor(0), memory(n) { }
+    LockfreeVector3(uint32_t n) : memory(n), cursor(0) { }
 
     ~LockfreeVector3() { }
 
@@ -25,6 +25,8 @@ OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWA
 #include <atomic>
 #include <memory>
 
+#include "LockfreeStats.h"
+
 #define SENTINEL 0
 
 template<typename T = uint32_t>
@@ -38,6 +40,8 @@ public:
         std::array<std::atomic<uint32_t>, 2> counter;
         uint8_t active;
 
+        mutable LockfreeStats stats;
+
         /**
          * Adds 1 to counter[A] and returns true, iff the following restrictions are met:
          * If B is true: expects counter[A] to be greater than 0, otherwise does nothing and returns false
@@ -46,13 +50,15 @@ public:
         template<unsigned int A, bool B>
         bool atomic_add() {
             uint32_t current = counter[A].load(std::memory_order_relaxed);
-            do {
+            while (true) {
                 if (B != (current > 0)) {
                     return false;
                 }
-            } 
-            while (!counter[A].compare_exchange_weak(current, current + 1, std::memory_order_relaxed, std::memory_order_relaxed));
-            return true;
+                if (counter[A].compare_exchange_weak(current, current + 1, std::memory_order_relaxed, std::memory_order_relaxed)) {
+                    return true;
+                }
+                stats.add(LockfreeStats::CAS_FAILURES);
+            }
         }
 
         // returns true iff counter[A] is greater than zero after the substraction
@@ -80,6 +86,7 @@ public:
                 else if (active == 1 && atomic_add<1, true>()) {
                     return 1;
                 }
+                stats.add(LockfreeStats::SPINS);
             }
         }
 
@@ -92,6 +99,7 @@ public:
                 else if (active == 0 && atomic_add<1, false>()) {
                     return true;
                 }
+                stats.add(LockfreeStats::SPINS);
             }
         }
 
@@ -113,8 +121,10 @@ public:
                     
                     for (unsigned int i = 0; i < cap-1; i++) {
                         if (old[i] != SENTINEL) fresh[i] = old[i];
-                        else i--;
+                        else { i--; stats.add(LockfreeStats::SPINS); } // slot claimed but not written yet
                     }
+                    stats.add(LockfreeStats::GROWS);
+                    stats.add(LockfreeStats::BYTES_COPIED, (cap-1) * sizeof(T));
 
                     memory = fresh;
                     capacity.store(cap * 2, std::memory_order_relaxed); // open GATE 1
@@ -166,7 +176,7 @@ private:
     LockfreeVector4(LockfreeVector4&& other) = delete;
 
 public:
-    LockfreeVector4(uint32_t n) : cursor(0), memory(n) { }
+    LockfreeVector4(uint32_t n) : memory(n), cursor(0) { }
 
     ~LockfreeVector4() { }
 
@@ -183,6 +193,11 @@ public:
         memory.set(pos, value);
     }
 
+    // contention and retry counters (see LockfreeStats)
+    inline LockfreeStats& statistics() const {
+        return memory.stats;
+    }
+
     inline const_iterator iter() {
         return const_iterator(memory);
     }
@@ -25,6 +25,9 @@ OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWA
 #include <atomic>
 #include <memory>
 
+#include "LockfreeLatency.h"
+#include "LockfreeStats.h"
+
 /**
  * T is the content type and must be integral
  * S is the sentinel element and must not occur in input
@@ -60,6 +63,8 @@ private:
     std::atomic<unsigned int> cursor;
     volatile unsigned int capacity;
 
+    mutable LockfreeStats stats;
+
     /**
      * Adds 1 to counter[A] and returns true, iff the following conditions are met:
      * If B is true: expects counter[A] to be greater than 0, otherwise does nothing and returns false
@@ -68,10 +73,11 @@ private:
     template<unsigned int A, bool B>
     bool atomic_add() {
         Q current = counter[A].load(std::memory_order_relaxed);
-        do {
+        while (true) {
             if (B != (current > 0)) { return false; }
-        } while (!counter[A].compare_exchange_weak(current, current + 1, std::memory_order_relaxed, std::memory_order_relaxed));
-        return true;
+            if (counter[A].compare_exchange_weak(current, current + 1, std::memory_order_relaxed, std::memory_order_relaxed)) return true;
+            stats.add(LockfreeStats::CAS_FAILURES);
+        }
     }
 
     /**
@@ -86,6 +92,7 @@ private:
             else if (active == 1) { 
                 if (atomic_add<1, true>()) return 1;
             }
+            stats.add(LockfreeStats::SPINS);
         }
     }
 
@@ -101,12 +108,15 @@ private:
             else if (active == 0) {
                 if (atomic_add<1, false>()) return true;
             }
+            stats.add(LockfreeStats::SPINS);
         }
     }
 
     void release_as_last(unsigned int act, T* mem) {
+        LOCKFREE_LATENCY_SCOPE(RECLAIM_WAIT);
         Q expect = 1;
         while (!counter[act].compare_exchange_weak(expect, 0, std::memory_order_relaxed, std::memory_order_relaxed)) {
+            stats.add(LockfreeStats::RECLAIM_WAITS);
             expect = 1;
         }
         free(mem);
@@ -117,7 +127,7 @@ private:
     LockfreeVector5(LockfreeVector5&& other) = delete;
 
 public:
-    LockfreeVector5(unsigned int n) : cursor(0), capacity(n + 1), counter(), active(0) {
+    LockfreeVector5(unsigned int n) : active(0), counter(), cursor(0), capacity(n + 1) {
         memory = (T*)std::calloc(capacity, sizeof(T));
         if (S != 0) memset(memory, S, capacity * sizeof(T));
         atomic_add<0, false>();
@@ -132,6 +142,7 @@ public:
     }
 
     void push(T value) {
+        LOCKFREE_LATENCY_SCOPE(PUSH);
         uint32_t pos = cursor.fetch_add(1, std::memory_order_relaxed);
         while (true) {
             uint32_t cap = capacity;
@@ -141,6 +152,7 @@ public:
                 return;
             } 
             else if (pos+1 == cap && acquire_inactive()) { // GATE 2
+                LOCKFREE_LATENCY_SCOPE(GROW);
                 std::atomic_thread_fence(std::memory_order_acquire);
                 T* old = memory;
                 T* fresh = (T*)calloc(cap * 2, sizeof(T));
@@ -148,8 +160,10 @@ public:
                 
                 for (unsigned int i = 0; i < cap-1; i++) {
                     if (old[i] != S) fresh[i] = old[i];
-                    else i--;
+                    else { i--; stats.add(LockfreeStats::SPINS); } // slot claimed but not written yet
                 }
+                stats.add(LockfreeStats::GROWS);
+                stats.add(LockfreeStats::BYTES_COPIED, (cap-1) * sizeof(T));
 
                 memory = fresh;
                 active ^= 1;
@@ -160,7 +174,13 @@ public:
         }
     }
 
+    // contention and retry counters (see LockfreeStats)
+    inline LockfreeStats& statistics() const {
+        return stats;
+    }
+
     inline const_iterator iter() {
+        LOCKFREE_LATENCY_SCOPE(BEGIN);
         unsigned int act = acquire_active();
         return const_iterator(memory, counter[act]);
     }
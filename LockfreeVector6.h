@@ -25,22 +25,25 @@ OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWA
 #include <atomic>
 #include <memory>
 
+#include "LockfreeEpoch.h"
+
 /**
  * T is the content type and must be integral
  * S is the sentinel element and must not occur in input
- * C maximal number of available hazards
+ * Outgrown memory is retired to an epoch-based reclamation domain, push never waits for readers
+ * Every iterator registers its own reader record, a thread can hold several iterators at once
  * */
-template<typename T = uint32_t, int S = 0, unsigned int C = 8>
+template<typename T = uint32_t, int S = 0>
 class LockfreeVector6 {
 public:
     class const_iterator {
+        LockfreeEpoch::guard guard; // initialized first: enter the domain before reading memory
         T* pos;
-        T** hazard;
 
     public:
-        const_iterator(T** mem) : pos(*mem), hazard(mem) { }
+        const_iterator(LockfreeEpoch& domain, T* const& mem) : guard(domain), pos(mem) { }
 
-        ~const_iterator() { *hazard = nullptr; }
+        ~const_iterator() { }
 
         inline const T operator * () const { return *pos; }
 
@@ -56,17 +59,16 @@ private:
     std::atomic<unsigned int> cursor;
     volatile unsigned int capacity;
 
-    std::array<T*, C> hazards; 
+    LockfreeEpoch domain; 
 
     LockfreeVector6(LockfreeVector6 const&) = delete;
     void operator=(LockfreeVector6 const&) = delete;
     LockfreeVector6(LockfreeVector6&& other) = delete;
 
 public:
-    LockfreeVector6(unsigned int n) : cursor(0), capacity(n + 1), hazards() {
+    LockfreeVector6(unsigned int n) : cursor(0), capacity(n + 1), domain() {
         memory = (T*)std::calloc(capacity, sizeof(T));
         if (S != 0) memset(memory, S, capacity * sizeof(T));
-        hazards.fill(nullptr);
     }
 
     ~LockfreeVector6() { 
@@ -77,16 +79,6 @@ public:
         return cursor.load(std::memory_order_relaxed);
     }
 
-    void safe_free(T* mem) {
-        for (bool safe = false; !safe; ) {
-            safe = true;
-            for (T* p : hazards) {
-                safe &= (p != mem);
-            }
-        }
-        free(mem);
-    }
-
     void push(T value) {
         uint32_t pos = cursor.fetch_add(1, std::memory_order_relaxed);
         while (true) {
@@ -110,15 +102,13 @@ public:
                 memory = fresh;
                 std::atomic_thread_fence(std::memory_order_release);
                 capacity *= 2; // open GATE 1
-                safe_free(old);
+                domain.retire(old);
             } 
         }
     }
 
-    inline const_iterator iter(unsigned int thread_id) {
-        assert(thread_id < C);
-        while (hazards[thread_id] != memory) hazards[thread_id] = memory;
-        return const_iterator(&hazards[thread_id]);
+    inline const_iterator iter() {
+        return const_iterator(domain, memory);
     }
 
 };
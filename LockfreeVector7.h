@@ -26,6 +26,8 @@ OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWA
 #include <memory>
 #include <vector>
 
+#include "LockfreeStats.h"
+
 /**
  * T is the content type and must be integral
  * N elements per page
@@ -73,6 +75,8 @@ private:
     alignas(2*sizeof(void*)) std::atomic<cursor_t> cursor;
     T* memory;
 
+    mutable LockfreeStats stats;
+
     LockfreeVector7(LockfreeVector7 const&) = delete;
     void operator=(LockfreeVector7 const&) = delete;
     LockfreeVector7(LockfreeVector7&& other) = delete;
@@ -101,7 +105,13 @@ public:
     void push(T value) {
         while (true) {
             cursor_t cur = cursor.load(std::memory_order_relaxed);
-            if (cur.pos <= (T*)cur.end && cursor.compare_exchange_weak(cur, { cur.pos + 1, cur.end }, std::memory_order_acq_rel)) {
+            if (cur.pos > (T*)cur.end) { // page switch in progress
+                stats.add(LockfreeStats::SPINS);
+            }
+            else if (!cursor.compare_exchange_weak(cur, { cur.pos + 1, cur.end }, std::memory_order_acq_rel)) {
+                stats.add(LockfreeStats::CAS_FAILURES);
+            }
+            else {
                 if (cur.pos < (T*)cur.end) {
                     *cur.pos = value;
                     return;
@@ -113,11 +123,17 @@ public:
                     //std::cout << "ATOMIC STORE: cur.pos=" << fresh << ", cur.end=" << fresh_end << std::endl;
                     *cur.end = fresh;
                     cursor.store({ fresh, fresh_end }, std::memory_order_release);
+                    stats.add(LockfreeStats::PAGE_SWITCHES);
                 }
             }
         }
     }
 
+    // contention and retry counters (see LockfreeStats)
+    inline LockfreeStats& statistics() const {
+        return stats;
+    }
+
     inline const_iterator begin() {
         return const_iterator(memory);
     }
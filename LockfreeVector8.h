@@ -26,6 +26,9 @@ OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWA
 #include <memory>
 #include <vector>
 
+#include "LockfreeLatency.h"
+#include "LockfreeStats.h"
+
 /**
  * T is the content type and must be integral
  * N elements per page
@@ -77,6 +80,8 @@ private:
     std::atomic<T*> pos;
     T** cpe; // current page end
 
+    mutable LockfreeStats stats;
+
     LockfreeVector8(LockfreeVector8 const&) = delete;
     void operator=(LockfreeVector8 const&) = delete;
     LockfreeVector8(LockfreeVector8&& other) = delete;
@@ -104,6 +109,7 @@ public:
     }
 
     void push(T value) {
+        LOCKFREE_LATENCY_SCOPE(PUSH);
         assert(value != S);
         while (true) {
             T* cur = pos.load(std::memory_order_acquire);
@@ -117,7 +123,11 @@ public:
                     *cur = value;
                     return;
                 }
-                else if (cur == (T*)cpe) { // all smaller pos are allocated
+                else if (cur != (T*)cpe) { // stalled across a page switch
+                    stats.add(LockfreeStats::SPINS);
+                }
+                else { // all smaller pos are allocated
+                    LOCKFREE_LATENCY_SCOPE(PAGE_ALLOC);
                     T* fresh = (T*)std::malloc(N * sizeof(T) + sizeof(T*));
                     T** fresh_end = (T**)(fresh + N);
                     std::fill(fresh, (T*)fresh_end, S);
@@ -128,14 +138,24 @@ public:
                     //^^ the above is now obsolete due to the full interval check after pos++, 
                     //which does also capture possibly stalled threads right before pos++,
                     //that rare case was not captured by the above "lock by minimum value"
-                    pos.store(fresh, std::memory_order_acq_rel);
+                    pos.store(fresh, std::memory_order_seq_cst); // acq_rel is no valid store order, compilers fall back to seq_cst
                     cpe = fresh_end; // unlock Gs
+                    stats.add(LockfreeStats::PAGE_SWITCHES);
                 } // loop to construct first element in new page
             }
+            else {
+                stats.add(LockfreeStats::SPINS);
+            }
         }
     }
 
+    // contention and retry counters (see LockfreeStats)
+    inline LockfreeStats& statistics() const {
+        return stats;
+    }
+
     inline const_iterator begin() {
+        LOCKFREE_LATENCY_SCOPE(BEGIN);
         return const_iterator(memory);
     }
 
@@ -24,49 +24,302 @@ OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWA
 #include <cstring> 
 #include <atomic>
 #include <memory>
+#include <new>
 #include <vector>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+
+#include "LockfreePageDirectory.h"
+#include "LockfreeEpoch.h"
+#include "LockfreeWait.h"
+#include "LockfreeScan.h"
+#include "LockfreeParallel.h"
+#include "LockfreeLatency.h"
+#include "LockfreeStats.h"
 
 /**
  * T is the content type and must be integral
  * N elements per page
  * S sentinel element
- * B counter bits, assert B <= 16, N < 2^B
+ * B counter bits, assert B <= 16, N + threads < 2^B (a push() that finds its page full overshoots the index by one)
+ * D tombstone element of erased elements, D == S disables erase()
+ * G elements on the first page, page k holds min(G * 2^k, N) elements, N / G must be a power of two
+ * 
+ * Pages hold their elements followed by the pointer to the next page, a commit counter and an erase counter.
+ * The counter is incremented after the elements are written, a page is sealed when all its elements are.
+ * Page pointers carry the size level of the page in their low bits (pages are aligned to 32 bytes), 
+ * so writers and readers learn the size of a page without touching it.
+ * compress() re-encodes sealed pages as varints (COMPRESSED tag), iterators decode them in chunks.
+ * Iterators skip tombstones, compact() rewrites pages with many of them. 
+ * Readers that might run concurrently with compact() must hold a guard from protect() while iterating.
+ * Alternatively the vector holds records, contiguous runs of elements behind a length header (see append_record()).
  * */
-template<typename T = uint32_t, unsigned int N = 1000, T S = 0, unsigned int B = 16>
+template<typename T = uint32_t, unsigned int N = 1000, T S = 0, unsigned int B = 16, T D = S, unsigned int G = N>
 class LockfreeVector9 {
+    static constexpr unsigned int levels(unsigned int ratio) {
+        return ratio > 1 ? 1 + levels(ratio / 2) : 0;
+    }
+
+    static constexpr unsigned int L = levels(N / G); // level of pages with N elements
+    static constexpr uintptr_t LEVEL = 15; // level bits of page pointers
+    static constexpr uintptr_t COMPRESSED = 16; // tag of pointers to compressed pages
+    static constexpr size_t ALIGN = 32;
+    static constexpr unsigned int CHUNK = 16; // elements per independently decodable run of a compressed page
+    static_assert(G > 0 && (G << L) == N && L <= LEVEL, "N / G must be a power of two below 2^16");
+
+    typedef typename std::make_unsigned<T>::type U;
+    typedef typename std::make_signed<U>::type I;
+
+    static inline T* untag(T* page) {
+        return (T*)((uintptr_t)page & ~(LEVEL | COMPRESSED));
+    }
+
+    static inline bool compressed(T* page) {
+        return (uintptr_t)page & COMPRESSED;
+    }
+
+    static inline unsigned int level(T* page) {
+        return (uintptr_t)page & LEVEL;
+    }
+
+    static inline unsigned int capacity(T* page) {
+        return G << level(page);
+    }
+
+    /**
+     * Compressed pages start with the next pointer and the counters, followed by the byte offsets 
+     * of their chunks and the encoded elements. The differences restart from 0 with every chunk, 
+     * so each chunk decodes on its own.
+     * */
+    static inline T** end_of(T* page) {
+        if (compressed(page)) return (T**)untag(page);
+        return (T**)(untag(page) + capacity(page));
+    }
+
+    static inline unsigned int chunk_count(unsigned int elements) {
+        return (elements + CHUNK - 1) / CHUNK;
+    }
+
+    static inline uint32_t* chunks(T* page) {
+        return (uint32_t*)(end_of(page) + 2);
+    }
+
+    // encoded elements of chunk k, expects the commit counter of the page to be set
+    static inline const uint8_t* encoded(T* page, unsigned int k = 0) {
+        unsigned int c = committed(end_of(page)).load(std::memory_order_relaxed);
+        return (const uint8_t*)(chunks(page) + chunk_count(c)) + chunks(page)[k];
+    }
+
+    // difference to the previous element, zigzag encoded as LEB128 varint
+    static inline uint8_t* encode(uint8_t* out, T value, T prev) {
+        U d = (U)((U)value - (U)prev);
+        U z = (U)((U)(d << 1) ^ (U)((I)d >> (8 * sizeof(U) - 1)));
+        while (z >= 0x80) {
+            *out++ = (uint8_t)(z | 0x80);
+            z >>= 7;
+        }
+        *out++ = (uint8_t)z;
+        return out;
+    }
+
+    // value holds the previous element and receives the next one
+    static inline const uint8_t* decode(const uint8_t* in, T& value) {
+        U z = 0;
+        for (unsigned int shift = 0; ; shift += 7) {
+            uint8_t byte = *in++;
+            z |= (U)(byte & 0x7f) << shift;
+            if (byte < 0x80) break;
+        }
+        value = (T)((U)value + (U)((z >> 1) ^ (U)(-(I)(z & 1))));
+        return in;
+    }
+
+    // decode the first n elements of the chunk at in to out
+    static inline const uint8_t* decode_run(const uint8_t* in, T* out, unsigned int n) {
+        T value = 0;
+        for (unsigned int j = 0; j < n; j++) {
+            in = decode(in, value);
+            out[j] = value;
+        }
+        return in;
+    }
+
+    // element j of a compressed page (S behind its committed elements), decodes at most one chunk
+    static inline T decode_at(T* page, unsigned int j) {
+        if (j >= committed(end_of(page)).load(std::memory_order_acquire)) return S;
+        const uint8_t* in = encoded(page, j / CHUNK);
+        T value = 0;
+        for (unsigned int n = 0; n <= j % CHUNK; n++) in = decode(in, value);
+        return value;
+    }
+
+    static inline std::atomic<unsigned int>& committed(T** end) {
+        return *(std::atomic<unsigned int>*)(end + 1);
+    }
+
+    // shares the pointer-sized slot of the commit counter
+    static inline std::atomic<unsigned int>& erased(T** end) {
+        static_assert(sizeof(T*) >= 2 * sizeof(unsigned int), "no room for the erase counter");
+        return *((std::atomic<unsigned int>*)(end + 1) + 1);
+    }
+
+    // index of the page holding slot i
+    static inline unsigned int page_of(size_t i) {
+        if (i >= N - G) return L + (unsigned int)((i - (N - G)) / N);
+        return 63 - __builtin_clzll((unsigned long long)(i / G + 1));
+    }
+
+    // index of the first slot of page k
+    static inline size_t first_slot(unsigned int k) {
+        if (k >= L) return (size_t)(N - G) + (size_t)(k - L) * N;
+        return (size_t)G * ((1ull << k) - 1);
+    }
+
 public:
     class const_iterator {
+        friend class LockfreeVector9;
+
         T* pos;
-        T** cpe; // current page end
+        T** cpe; // current page end (compressed pages: their start, which holds the next pointer)
+        unsigned int left; // committed elements left on this page (compressed pages: in buf), including *pos
+        bool sealed; // all elements of this page are committed
+        const uint8_t* enc; // next encoded element of a compressed page, nullptr on other pages
+        unsigned int rest; // elements of a compressed page that are not decoded yet
+        T buf[CHUNK];
+        T* stop; // untagged page where iteration ends, nullptr: end of the chain
+
+        inline void skip_holes() {
+            while (*pos == S) ++pos; // slot claimed by a writer that has not committed yet
+        }
 
-        inline void hop() { 
-            // hop from cpe to next page begin
-            if (pos == (T*)cpe) { 
-                pos = *cpe; 
-                if (pos != nullptr) cpe = (T**)(pos + N); 
+        inline void decode_chunk() {
+            left = std::min(rest, CHUNK);
+            rest -= left;
+            enc = decode_run(enc, buf, left);
+            pos = buf;
+        }
+
+        inline void next() {
+            ++pos; 
+            if (--left == 0) { 
+                if (rest > 0) decode_chunk();
+                else enter(*cpe); // hop to next page
+            }
+            else if (!sealed) skip_holes(); // sealed pages need no sentinel checks
+        }
+
+        inline void skip_erased() {
+            if (D != S) while (pos != nullptr && *pos == D) next();
+        }
+
+        inline void enter(T* page) { 
+            // position at the first committed element in page or the pages after
+            while (page != nullptr && untag(page) != stop) {
+                cpe = end_of(page);
+                left = committed(cpe).load(std::memory_order_acquire);
+                if (left > 0 && compressed(page)) {
+                    enc = encoded(page);
+                    rest = left;
+                    sealed = true;
+                    decode_chunk();
+                    return;
+                }
+                if (left > 0) {
+                    enc = nullptr;
+                    pos = untag(page);
+                    sealed = (left == capacity(page));
+                    if (!sealed) skip_holes();
+                    return;
+                }
+                page = *cpe;
             }
+            pos = nullptr;
+            enc = nullptr;
         }
 
     public:
-        const_iterator(T* mem) : pos(mem), cpe((T**)(mem + N)) { }
+        typedef std::forward_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef T reference;
+
+        const_iterator(T* page = nullptr) : pos(nullptr), cpe(nullptr), left(0), sealed(false), enc(nullptr), rest(0), stop(nullptr) { 
+            enter(page);
+            skip_erased();
+        }
+
+        // element j of compressed page, starts decoding at the chunk holding j
+        const_iterator(T* page, unsigned int j) : pos(nullptr), cpe(end_of(page)), left(0), sealed(true), enc(nullptr), rest(0), stop(nullptr) { 
+            unsigned int c = committed(cpe).load(std::memory_order_acquire);
+            if (j < c) {
+                enc = encoded(page, j / CHUNK);
+                rest = c - j / CHUNK * CHUNK;
+                decode_chunk();
+                pos += j % CHUNK;
+                left -= j % CHUNK;
+            }
+            else enter(*cpe);
+            skip_erased();
+        }
+
+        const_iterator(T* pos_, T* page) : pos(pos_), cpe(end_of(page)), left(0), sealed(false), enc(nullptr), rest(0), stop(nullptr) { 
+            unsigned int c = committed(cpe).load(std::memory_order_acquire);
+            if (c == capacity(page)) {
+                left = (T*)cpe - pos;
+                sealed = true;
+            }
+            else {
+                for (T* p = pos; p < (T*)cpe; p++) left += (*p != S);
+                left = std::min(left, c);
+                if (left > 0) skip_holes();
+                else enter(*cpe);
+            }
+            skip_erased();
+        }
+
+        const_iterator(const const_iterator& other) {
+            *this = other;
+        }
+
+        const_iterator& operator = (const const_iterator& other) {
+            pos = other.pos;
+            cpe = other.cpe;
+            left = other.left;
+            sealed = other.sealed;
+            enc = other.enc;
+            rest = other.rest;
+            stop = other.stop;
+            if (enc != nullptr && pos != nullptr) { // points into other.buf
+                std::copy(other.buf, other.buf + CHUNK, buf);
+                pos = buf + (other.pos - other.buf);
+            }
+            return *this;
+        }
+
         ~const_iterator() { }
 
-        inline const T operator * () { 
+        inline T operator * () const { 
             assert(pos != nullptr);
             return *pos; 
         }
 
         inline const_iterator& operator ++ () { 
-            ++pos; 
-            if (pos == (T*)cpe) { // hop from cpe to next page begin
-                pos = *cpe; 
-                if (pos != nullptr) cpe = (T**)(pos + N); 
-            }
-            if (pos != nullptr && *pos == S) pos = nullptr;
+            next();
+            skip_erased();
             return *this; 
         }
 
-        inline bool operator != (const const_iterator& other) { // page end and next page begin are equal
+        inline const_iterator operator ++ (int) { 
+            const_iterator it = *this;
+            ++*this;
+            return it; 
+        }
+
+        // iterators on compressed pages point into their own buffers, they compare page and remaining elements
+        inline bool operator != (const const_iterator& other) const {
+            if (enc != nullptr && other.enc != nullptr) return cpe != other.cpe || rest + left != other.rest + other.left;
             return pos != other.pos;    
         }
 
@@ -77,74 +330,678 @@ public:
     
 
 private:
-    T* memory;
+    std::atomic<T*> memory;
     std::atomic<uintptr_t> pos;
+    LockfreePageDirectory<T> directory; // page pointers without level bits, compressed pages keep their COMPRESSED tag
+    LockfreeEpoch domain; // delays freeing of compacted pages
+    mutable LockfreeStats stats;
+    mutable std::atomic<uint32_t> waiters; // threads in wait_for_new(), producers notify only if there are any
+
+    static constexpr unsigned int PACKED = 1u << 31; // erase counter flag of pages written by compact()
 
-    inline unsigned int get_index(uintptr_t pos) {
+    static inline unsigned int get_index(uintptr_t pos) {
         return pos & ((1 << B) - 1);
     }
 
-    inline T* get_page(uintptr_t pos) {
+    // tagged page pointer
+    static inline T* get_page(uintptr_t pos) {
         return (T*)(pos >> B);
     }
 
+    static constexpr T PAD = (T)((U)S + 1); // record header of the unused rest of a page
+
+    static inline T header(size_t len) {
+        return (T)((U)S + 2 + (U)len);
+    }
+
+    static inline size_t length(T header) {
+        return (U)((U)header - (U)S) - 2;
+    }
+
+    template<typename Iterator>
+    static inline Iterator copy_run(Iterator first, T* dest, unsigned int k) {
+        for (unsigned int j = 0; j < k; ++j, ++first) {
+            assert(*first != S && (D == S || *first != D));
+            dest[j] = *first;
+        }
+        return first;
+    }
+
     LockfreeVector9(LockfreeVector9 const&) = delete;
     void operator=(LockfreeVector9 const&) = delete;
     LockfreeVector9(LockfreeVector9&& other) = delete;
 
+    void set_next(T* page, T* next) {
+        T** cpe = end_of(page);
+        *cpe = next; // glue the segments
+    }
+
+    template<typename Iterator>
+    static inline void write_record(T* dest, Iterator first, size_t len) {
+        for (size_t j = 1; j <= len; ++j, ++first) dest[j] = *first;
+        __atomic_store_n(dest, header(len), __ATOMIC_RELEASE); // publishes the elements
+    }
+
+    // close page from slot i on for records
+    static inline void pad(T* page, unsigned int i) {
+        __atomic_store_n(untag(page) + i, PAD, __ATOMIC_RELEASE);
+        committed(end_of(page)).fetch_add(capacity(page) - i, std::memory_order_release);
+    }
+
+    static inline T* allocate(size_t bytes) {
+        return (T*)std::aligned_alloc(ALIGN, (bytes + ALIGN - 1) / ALIGN * ALIGN);
+    }
+
+    // returns the tagged pointer to a page of level l
+    T* new_page(unsigned int l) {
+        T* page = allocate((G << l) * sizeof(T) + 2 * sizeof(T*));
+        page = (T*)((uintptr_t)page | l);
+        std::fill(untag(page), untag(page) + capacity(page), S);
+        set_next(page, nullptr);
+        new (&committed(end_of(page))) std::atomic<unsigned int>(0);
+        new (&erased(end_of(page))) std::atomic<unsigned int>(0);
+        return page;
+    }
+
+    // called by the thread that claimed the last index of page, the first m slots of the fresh page are its own
+    T* switch_page(T* page, unsigned int m) {
+        LOCKFREE_LATENCY_SCOPE(PAGE_ALLOC);
+        T* fresh = new_page(std::min(level(page) + 1, L));
+        directory.append(untag(fresh));
+        //^^^^^^ until here it's uncritical
+        set_next(page, fresh); //now readers know about the new page
+        pos.store(((uintptr_t)fresh << B) + m, std::memory_order_release);
+        stats.add(LockfreeStats::PAGE_SWITCHES);
+        return fresh;
+    }
+
 public:
-    LockfreeVector9() {
-        memory = (T*)std::malloc(N * sizeof(T) + sizeof(T*));
-        pos.store((uintptr_t)memory << B, std::memory_order_relaxed);
-        std::fill(memory, memory + N, S);
-        T** cpe = (T**)(memory + N);
-        *cpe = nullptr; // to glue the segments together
+    LockfreeVector9() : domain(), waiters(0) {
+        T* page = new_page(0);
+        memory.store(page, std::memory_order_relaxed);
+        directory.append(page);
+        pos.store((uintptr_t)page << B, std::memory_order_relaxed);
     }
 
     ~LockfreeVector9() { 
-        T* mem = memory;
+        domain.drain();
+        T* mem = memory.load(std::memory_order_relaxed);
         while (mem != nullptr) {
-            memory = *(T**)(mem + N);
-            free(mem);
-            mem = memory;
+            T* next = *end_of(mem);
+            free(untag(mem));
+            mem = next;
         }
     }
 
     void push(T value) {
-        assert(value != S);
+        LOCKFREE_LATENCY_SCOPE(PUSH);
+        assert(value != S && (D == S || value != D));
         while (true) {
             uintptr_t cur = pos.load(std::memory_order_acquire);
             unsigned int i = get_index(cur);
-            if (i <= N) { // block pos++ during realloc (busy-loop)
+            if (i <= capacity(get_page(cur))) { // block pos++ during realloc (busy-loop)
                 cur = pos.fetch_add(1, std::memory_order_acq_rel);
                 i = get_index(cur);
-                T* mem = get_page(cur);
-                if (i < N) { 
-                    mem[i] = value;
+                T* page = get_page(cur);
+                unsigned int n = capacity(page);
+                if (i < n) { 
+                    untag(page)[i] = value;
+                    committed(end_of(page)).fetch_add(1, std::memory_order_release);
+                    LockfreeWait::notify(this, waiters);
                     return;
                 }
-                else if (i == N) { // all smaller pos are allocated
-                    T* fresh = (T*)std::malloc(N * sizeof(T) + sizeof(T*));
-                    std::fill(fresh, fresh + N, S);
-                    T** cpe = (T**)(fresh + N);
-                    *cpe = nullptr;
-                    //^^^^^^ until here it's uncritical
-                    cpe = (T**)(mem + N);
-                    *cpe = fresh; //now readers know about the new page
-                    pos.store((uintptr_t)fresh << B, std::memory_order_release);
+                else if (i == n) { // all smaller pos are allocated
+                    switch_page(page, 0);
                 } // loop to construct first element in new page
+                else stats.add(LockfreeStats::SPINS);
+            }
+            else stats.add(LockfreeStats::SPINS);
+        }
+    }
+
+    /**
+     * Push the elements of [first, last) with one claim per page instead of one per element.
+     * The run is split at page boundaries: whoever claims a run covering the last index writes its head 
+     * to the current page, switches the page and claims up to all slots of the fresh page directly.
+     * The elements of one batch are contiguous unless the batch crosses a page switch.
+     * Runs are claimed with a CAS against the loaded page, so they never move the index past n + 1.
+     * */
+    template<typename Iterator>
+    void push(Iterator first, Iterator last) {
+        LOCKFREE_LATENCY_SCOPE(PUSH);
+        size_t rest = std::distance(first, last);
+        while (rest > 0) {
+            uintptr_t cur = pos.load(std::memory_order_acquire);
+            unsigned int i = get_index(cur);
+            T* page = get_page(cur);
+            unsigned int n = capacity(page);
+            if (i <= n) { // block pos+=k during realloc (busy-loop)
+                // the run that covers the last index claims one more slot, i.e. the page switch
+                unsigned int k = rest <= n - i ? (unsigned int)rest : n - i + 1;
+                if (!pos.compare_exchange_weak(cur, cur + k, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                    stats.add(LockfreeStats::SPINS);
+                }
+                else if (i + k <= n) {
+                    first = copy_run(first, untag(page) + i, k);
+                    committed(end_of(page)).fetch_add(k, std::memory_order_release);
+                    rest -= k;
+                }
+                else { // run covers the last index, i.e. all smaller pos are allocated
+                    first = copy_run(first, untag(page) + i, n - i);
+                    if (i < n) committed(end_of(page)).fetch_add(n - i, std::memory_order_release);
+                    rest -= n - i;
+                    unsigned int m = (unsigned int)std::min<size_t>(rest, G << std::min(level(page) + 1, L));
+                    T* fresh = switch_page(page, m);
+                    first = copy_run(first, untag(fresh), m);
+                    if (m > 0) committed(end_of(fresh)).fetch_add(m, std::memory_order_release);
+                    rest -= m;
+                }
             }
+            else stats.add(LockfreeStats::SPINS);
         }
+        LockfreeWait::notify(this, waiters);
     }
 
-    inline const_iterator begin() {
-        return const_iterator((*memory == S) ? nullptr : memory);
+    inline void push(const T* values, size_t n) {
+        push(values, values + n);
     }
 
-    inline const_iterator end() {
+    /**
+     * Append [first, last) as one record: a header holding the length followed by the elements, 
+     * reserved in one page by a single CAS. The header is written last, so readers of records() 
+     * never see a partial record. The claim that covers the last index of a page pads the rest 
+     * of the page with PAD and places its record on the fresh page (pages too small for it are padded as well).
+     * Records take at most N slots including the header, elements are unrestricted.
+     * Vectors of records are read with records() and must not be used with push(), erase() or compact().
+     * */
+    template<typename Iterator>
+    void append_record(Iterator first, Iterator last) {
+        size_t len = std::distance(first, last);
+        unsigned int k = (unsigned int)len + 1;
+        assert(k <= N);
+        while (true) {
+            uintptr_t cur = pos.load(std::memory_order_acquire);
+            unsigned int i = get_index(cur);
+            T* page = get_page(cur);
+            unsigned int n = capacity(page);
+            if (i <= n) { // block pos+=k during realloc (busy-loop)
+                // a record that does not fit claims the rest of the page and the page switch
+                unsigned int c = i + k <= n ? k : n - i + 1;
+                if (!pos.compare_exchange_weak(cur, cur + c, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                    stats.add(LockfreeStats::SPINS);
+                }
+                else if (i + k <= n) {
+                    write_record(untag(page) + i, first, len);
+                    committed(end_of(page)).fetch_add(k, std::memory_order_release);
+                    break;
+                }
+                else { // claim covers the last index, i.e. all smaller pos are allocated
+                    if (i < n) pad(page, i);
+                    unsigned int m = G << std::min(level(page) + 1, L);
+                    if (k <= m) {
+                        T* fresh = switch_page(page, k);
+                        write_record(untag(fresh), first, len);
+                        committed(end_of(fresh)).fetch_add(k, std::memory_order_release);
+                        break;
+                    }
+                    pad(switch_page(page, m), 0); // loop to the next page
+                }
+            }
+            else stats.add(LockfreeStats::SPINS);
+        }
+        LockfreeWait::notify(this, waiters);
+    }
+
+    inline void append_record(const T* values, size_t n) {
+        append_record(values, values + n);
+    }
+
+    /**
+     * Number of claimed slots, claimed slots are constructed shortly after (until then they read S)
+     * */
+    inline size_t size() const {
+        while (true) {
+            uintptr_t cur = pos.load(std::memory_order_acquire);
+            unsigned int pages = directory.size_if_back(untag(get_page(cur)));
+            if (pages > 0) { // retry during page switch
+                return first_slot(pages-1) + std::min(get_index(cur), capacity(get_page(cur)));
+            }
+        }
+    }
+
+    // expects i < size(), decodes up to CHUNK elements on compressed pages
+    inline T operator [] (size_t i) const {
+        unsigned int k = page_of(i);
+        T* page = directory[k];
+        if (compressed(page)) return decode_at(page, (unsigned int)(i - first_slot(k)));
+        return page[i - first_slot(k)];
+    }
+
+    // iterator starting at slot i, skips slots that are not committed yet
+    inline const_iterator seek(size_t i) const {
+        if (i >= size()) return end();
+        unsigned int k = page_of(i);
+        T* page = (T*)((uintptr_t)directory[k] | std::min(k, L));
+        if (compressed(page)) return const_iterator(page, (unsigned int)(i - first_slot(k)));
+        return const_iterator(untag(page) + (i - first_slot(k)), page);
+    }
+
+    // contention and retry counters (see LockfreeStats)
+    inline LockfreeStats& statistics() const {
+        return stats;
+    }
+
+    inline const_iterator begin() const {
+        LOCKFREE_LATENCY_SCOPE(BEGIN);
+        return const_iterator(memory.load(std::memory_order_acquire));
+    }
+
+    inline const_iterator end() const {
         return const_iterator(nullptr);
     }
 
+    /**
+     * Call f(first, n) on the committed runs of the pages until it returns true, so that whole pages 
+     * go through the kernels of LockfreeScan. Unsealed pages are cut at their first uncommitted slot 
+     * (sentinel frontier), compressed pages are decoded in chunks. Runs include tombstones.
+     * Returns whether f stopped the scan.
+     * */
+    template<typename F>
+    bool scan(F f) const {
+        T buf[4 * CHUNK];
+        for (T* page = memory.load(std::memory_order_acquire); page != nullptr; page = *end_of(page)) {
+            unsigned int c = committed(end_of(page)).load(std::memory_order_acquire);
+            if (compressed(page)) {
+                const uint8_t* in = encoded(page);
+                for (unsigned int j = 0; j < c; ) {
+                    unsigned int m = std::min(c - j, 4 * CHUNK);
+                    for (unsigned int k = 0; k < m; k += CHUNK) in = decode_run(in, buf + k, std::min(m - k, CHUNK));
+                    if (f((const T*)buf, m)) return true;
+                    j += m;
+                }
+            }
+            else {
+                T* mem = untag(page);
+                unsigned int n = capacity(page);
+                if (c < n) n = (unsigned int)LockfreeScan::find(mem, n, S);
+                if (n > 0 && f((const T*)mem, n)) return true;
+            }
+        }
+        return false;
+    }
+
+    // number of elements equal to value, which is neither S nor D (see LockfreeScan)
+    inline size_t count(T value) const {
+        return LockfreeScan::count(*this, value);
+    }
+
+    inline bool contains(T value) const {
+        return LockfreeScan::contains(*this, value);
+    }
+
+    // first element for which pred returns true, skips tombstones
+    template<typename Predicate>
+    bool find_first(Predicate pred, T& value) const {
+        return LockfreeScan::find_first(*this, [&pred] (T v) { return (D == S || v != D) && pred(v); }, value);
+    }
+
+    // append the elements in [lo, hi] to out, skips tombstones, returns their number
+    size_t filter(T lo, T hi, std::vector<T>& out) const {
+        size_t k = out.size();
+        LockfreeScan::filter(*this, lo, hi, out);
+        if (D != S && lo <= D && D <= hi) out.erase(std::remove(out.begin() + k, out.end(), D), out.end());
+        return out.size() - k;
+    }
+
+    /**
+     * Splittable range of the pages [first, last) that iterates their elements (see LockfreeParallel).
+     * Page ranges expect that no compact() or compress() runs concurrently.
+     * */
+    class page_range {
+        const LockfreeVector9* vector;
+        unsigned int first, last;
+        unsigned int grain;
+
+    public:
+        page_range(const LockfreeVector9* vector_, unsigned int first_, unsigned int last_, unsigned int grain_ = 1) 
+            : vector(vector_), first(first_), last(last_), grain(std::max(grain_, 1u)) { }
+
+        template<typename Split>
+        page_range(page_range& other, Split) : vector(other.vector), first(other.first + (other.last - other.first) / 2), last(other.last), grain(other.grain) { 
+            other.last = first;
+        }
+
+        inline bool empty() const { return first >= last; }
+        inline bool is_divisible() const { return last > first && last - first > grain; }
+        inline size_t size() const { return empty() ? 0 : last - first; }
+
+        // the last range of a vector extends to pages appended after it was made
+        const_iterator begin() const {
+            if (empty()) return end();
+            const_iterator it;
+            it.stop = last < vector->directory.size() ? untag(vector->directory[last]) : nullptr;
+            it.enter((T*)((uintptr_t)vector->directory[first] | std::min(first, L)));
+            it.skip_erased();
+            return it;
+        }
+
+        inline const_iterator end() const {
+            return const_iterator(nullptr);
+        }
+    };
+
+    // all pages, e.g. for tbb::parallel_for() or std::for_each(std::execution::par, ...)
+    inline page_range pages(unsigned int grain = 1) const {
+        return page_range(this, 0, directory.size(), grain);
+    }
+
+    // call f(value) on the elements with the pages spread over threads
+    template<typename F>
+    void parallel_for_each(F f, unsigned int threads = LockfreeParallel::concurrency()) const {
+        LockfreeParallel::for_each(pages(), [&f] (const page_range& range) { 
+            for (T value : range) f(value); 
+        }, threads);
+    }
+
+    // join of acc = f(acc, value) over the elements per page range, init is the identity of join
+    template<typename V, typename F, typename Join>
+    V parallel_reduce(V init, F f, Join join, unsigned int threads = LockfreeParallel::concurrency()) const {
+        return LockfreeParallel::reduce(pages(), init, [&f] (const page_range& range, V acc) { 
+            for (T value : range) acc = f(acc, value); 
+            return acc;
+        }, join, threads);
+    }
+
+    // elements of one record
+    struct record {
+        const T* first;
+        size_t n;
+
+        inline const T* begin() const { return first; }
+        inline const T* end() const { return first + n; }
+        inline size_t size() const { return n; }
+        inline T operator [] (size_t j) const { return first[j]; }
+    };
+
+    /**
+     * Iterates the records in append order up to the first one whose header is not written yet 
+     * (records behind it might be complete already, they show up in later iterations)
+     * */
+    class record_iterator {
+        T* page; // tagged, nullptr at the end
+        unsigned int index;
+        record current;
+
+        inline void settle() { // position at the record at index or behind
+            while (page != nullptr) {
+                if (index < capacity(page)) {
+                    T h = __atomic_load_n(untag(page) + index, __ATOMIC_ACQUIRE);
+                    if (h == S) break; // not written yet
+                    if (h != PAD) {
+                        current = record { untag(page) + index + 1, length(h) };
+                        return;
+                    }
+                }
+                page = *end_of(page);
+                index = 0;
+            }
+            page = nullptr;
+            index = 0;
+        }
+
+    public:
+        record_iterator(T* page_) : page(page_), index(0), current { nullptr, 0 } { 
+            settle();
+        }
+
+        inline record operator * () const { 
+            assert(page != nullptr);
+            return current; 
+        }
+
+        inline record_iterator& operator ++ () { 
+            index += (unsigned int)current.n + 1;
+            settle();
+            return *this; 
+        }
+
+        inline bool operator != (const record_iterator& other) const {
+            return page != other.page || index != other.index;
+        }
+
+        inline bool operator == (const record_iterator& other) const {
+            return !(*this != other);
+        }
+    };
+
+    struct record_range {
+        record_iterator first;
+
+        inline record_iterator begin() const { return first; }
+        inline record_iterator end() const { return record_iterator(nullptr); }
+    };
+
+    // records appended by append_record(), for (auto record : vec.records()) { for (T value : record) ... }
+    inline record_range records() const {
+        return record_range { record_iterator(memory.load(std::memory_order_acquire)) };
+    }
+
+    // position of a tailing reader, a default constructed cursor starts at the beginning
+    struct cursor {
+        T* page = nullptr;
+        unsigned int index = 0;
+    };
+
+    /**
+     * Call f(value) on the elements from c on up to the first slot that is not committed yet 
+     * and advance c behind them, so that a later poll() delivers only the elements appended since.
+     * Returns the number of delivered elements. 
+     * Cursors must not be held across compact() or compress(), which free the pages they point to.
+     * */
+    template<typename F>
+    size_t poll(cursor& c, F f) const {
+        size_t n = 0;
+        if (c.page == nullptr) c.page = memory.load(std::memory_order_acquire);
+        while (true) {
+            T* mem = untag(c.page);
+            T** end = end_of(c.page);
+            if (compressed(c.page)) {
+                T buf[CHUNK];
+                unsigned int count = committed(end).load(std::memory_order_acquire);
+                for (unsigned int k = c.index / CHUNK; k < chunk_count(count); k++) {
+                    unsigned int m = std::min(count - k * CHUNK, CHUNK);
+                    decode_run(encoded(c.page, k), buf, m);
+                    for (unsigned int j = (k == c.index / CHUNK) ? c.index % CHUNK : 0; j < m; j++) {
+                        if (D == S || buf[j] != D) {
+                            f(buf[j]);
+                            n++;
+                        }
+                    }
+                }
+                c.index = capacity(c.page);
+            }
+            else for (unsigned int cap = capacity(c.page); c.index < cap; c.index++) {
+                T value = mem[c.index];
+                if (value == S) { 
+                    if (erased(end).load(std::memory_order_relaxed) & PACKED) break; // end of a compacted page
+                    return n; // not committed yet
+                }
+                if (D == S || value != D) {
+                    f(value);
+                    n++;
+                }
+            }
+            T* next = *end;
+            if (next == nullptr) return n;
+            c.page = next;
+            c.index = 0;
+        }
+    }
+
+    // poll(c) would deliver at least one element (or a tombstone), follows the chain past exhausted pages
+    inline bool has_new(const cursor& c) const {
+        T* page = c.page != nullptr ? c.page : memory.load(std::memory_order_acquire);
+        unsigned int i = c.page != nullptr ? c.index : 0;
+        while (page != nullptr) {
+            T** end = end_of(page);
+            if (compressed(page)) {
+                if (i < committed(end).load(std::memory_order_acquire)) return true;
+            }
+            else if (i < capacity(page)) {
+                if (untag(page)[i] != S) return true;
+                if (!(erased(end).load(std::memory_order_relaxed) & PACKED)) return false; // not committed yet
+            }
+            page = *end;
+            i = 0;
+        }
+        return false;
+    }
+
+    /**
+     * Block until poll(c) has new elements or the timeout expires, returns false on timeout
+     * Producers notify only if a waiter is parked (see LockfreeWait)
+     * */
+    template<class Rep, class Period>
+    bool wait_for_new(const cursor& c, std::chrono::duration<Rep, Period> timeout) const {
+        return LockfreeWait::wait(this, waiters, [this, &c] { return has_new(c); }, std::chrono::duration_cast<std::chrono::nanoseconds>(timeout));
+    }
+
+    /**
+     * Replace the element at it by the tombstone D, iterators skip it from now on
+     * (iterators that are positioned at it already read D)
+     * Returns false if it was erased already or lies in a compressed page
+     * */
+    bool erase(const const_iterator& it) {
+        static_assert(D != S, "erase() needs a tombstone D != S");
+        if (it.enc != nullptr) return false;
+        T value = *it.pos;
+        if (value == D || !__atomic_compare_exchange_n(it.pos, &value, D, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) return false;
+        erased(it.cpe).fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // erase all elements for which pred returns true, returns the number of erased elements
+    template<typename Predicate>
+    size_t erase_if(Predicate pred) {
+        size_t n = 0;
+        for (const_iterator it = begin(); it != end(); ++it) {
+            if (pred(*it) && erase(it)) n++;
+        }
+        return n;
+    }
+
+    // readers that may run concurrently with compact() hold a guard while iterating
+    inline LockfreeEpoch::guard protect() {
+        return LockfreeEpoch::guard(domain);
+    }
+
+    /**
+     * Rewrite pages with at least min_erased tombstones (at most half of the page size), their remaining 
+     * elements are packed to the front of a fresh page which replaces the old one in the chain and the directory.
+     * Only pages that are followed by another page and whose claimed slots are all committed 
+     * are rewritten, so pushes are never blocked. The old pages are freed once no reader 
+     * holding a guard can see them.
+     * Positions (operator[], seek()) of elements in rewritten pages change.
+     * Expects that only one thread at a time runs compact() and that no erase() runs concurrently.
+     * Returns the number of rewritten pages.
+     * */
+    size_t compact(unsigned int min_erased = N / 2) {
+        static_assert(D != S, "compact() needs a tombstone D != S");
+        size_t n = 0;
+        T* prev = nullptr;
+        T* page = memory.load(std::memory_order_acquire);
+        for (unsigned int k = 0; ; k++) {
+            T* next = *end_of(page);
+            if (next == nullptr) break; // pushers might still claim slots
+            if (compressed(page)) {
+                prev = page;
+                page = next;
+                continue;
+            }
+            unsigned int e = erased(end_of(page)).load(std::memory_order_relaxed);
+            unsigned int c = committed(end_of(page)).load(std::memory_order_acquire);
+            unsigned int threshold = std::max(1u, std::min(min_erased, capacity(page) / 2));
+            if ((e & ~PACKED) >= threshold && (c == capacity(page) || (e & PACKED))) {
+                T* fresh = new_page(level(page));
+                unsigned int live = 0;
+                for (unsigned int j = 0; j < c; j++) {
+                    if (untag(page)[j] != D) untag(fresh)[live++] = untag(page)[j];
+                }
+                stats.add(LockfreeStats::BYTES_COPIED, live * sizeof(T));
+                committed(end_of(fresh)).store(live, std::memory_order_relaxed);
+                erased(end_of(fresh)).store(PACKED, std::memory_order_relaxed);
+                set_next(fresh, next);
+                std::atomic_thread_fence(std::memory_order_release);
+                directory.replace(k, untag(page), untag(fresh));
+                if (prev != nullptr) set_next(prev, fresh); //now readers know about the fresh page
+                else memory.store(fresh, std::memory_order_release);
+                domain.retire(untag(page));
+                page = fresh;
+                n++;
+            }
+            prev = page;
+            page = next;
+        }
+        return n;
+    }
+
+    /**
+     * Re-encode sealed pages as differences of consecutive elements in zigzag varints, 
+     * i.e. one byte per element for lists of close small values. Pages that would not shrink are kept.
+     * Iterators decode compressed pages in chunks, operator[] and seek() decode from the start of the chunk.
+     * The compressed page replaces the old one like in compact() and with the same restrictions, 
+     * so this can run as a background step: only pages followed by another page are rewritten, 
+     * readers that may run concurrently hold a guard from protect(), only one thread at a time runs 
+     * compact() or compress(), and erase() runs neither concurrently nor on compressed pages.
+     * Returns the number of compressed pages.
+     * */
+    size_t compress() {
+        size_t n = 0;
+        std::vector<uint8_t> out((size_t)N * (8 * sizeof(T) / 7 + 1));
+        std::vector<uint32_t> offsets(chunk_count(N));
+        T* prev = nullptr;
+        T* page = memory.load(std::memory_order_acquire);
+        for (unsigned int k = 0; ; k++) {
+            T* next = *end_of(page);
+            if (next == nullptr) break; // pushers might still claim slots
+            unsigned int e = erased(end_of(page)).load(std::memory_order_relaxed);
+            unsigned int c = committed(end_of(page)).load(std::memory_order_acquire);
+            if (!compressed(page) && c > 0 && (c == capacity(page) || (e & PACKED))) {
+                uint8_t* end = out.data();
+                T last = 0;
+                for (unsigned int j = 0; j < c; j++) {
+                    if (j % CHUNK == 0) { // chunks decode on their own
+                        offsets[j / CHUNK] = (uint32_t)(end - out.data());
+                        last = 0;
+                    }
+                    end = encode(end, untag(page)[j], last);
+                    last = untag(page)[j];
+                }
+                size_t table = chunk_count(c) * sizeof(uint32_t);
+                size_t bytes = end - out.data();
+                if (table + bytes < capacity(page) * sizeof(T)) {
+                    T* fresh = allocate(2 * sizeof(T*) + table + bytes);
+                    fresh = (T*)((uintptr_t)fresh | COMPRESSED | level(page));
+                    set_next(fresh, next);
+                    new (&committed(end_of(fresh))) std::atomic<unsigned int>(c);
+                    new (&erased(end_of(fresh))) std::atomic<unsigned int>(e);
+                    std::memcpy(chunks(fresh), offsets.data(), table);
+                    std::memcpy((uint8_t*)encoded(fresh), out.data(), bytes);
+                    std::atomic_thread_fence(std::memory_order_release);
+                    directory.replace(k, untag(page), (T*)((uintptr_t)untag(fresh) | COMPRESSED));
+                    if (prev != nullptr) set_next(prev, fresh); //now readers know about the fresh page
+                    else memory.store(fresh, std::memory_order_release);
+                    domain.retire(untag(page));
+                    page = fresh;
+                    n++;
+                }
+            }
+            prev = page;
+            page = next;
+        }
+        return n;
+    }
+
 };
 
-#endif
\ No newline at end of file
+#endif
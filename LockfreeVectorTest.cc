@@ -15,57 +15,90 @@
 #include "LockfreeVector7.h"
 #include "LockfreeVector8.h"
 #include "LockfreeVector9.h"
+#include "LockfreeVector10.h"
 #include "LockfreeMap.h"
 #include "LockfreeMap2.h"
 #include "LockfreeMap3.h"
+#include "LockfreeHashMap.h"
+#include "LockfreeWriteBuffer.h"
 
 typedef LockfreeVector<uint32_t> myvec;
 typedef LockfreeVector2<uint32_t> myvec2;
 typedef LockfreeVector3<uint32_t> myvec3;
 typedef LockfreeVector4<uint32_t> myvec4;
 typedef LockfreeVector5<int32_t, 0> myvec5;
-typedef LockfreeVector6<int32_t, 0, 50> myvec6;
+typedef LockfreeVector6<int32_t, 0> myvec6;
 typedef LockfreeVector7<uint32_t, 1000> myvec7;
 typedef LockfreeVector8<uint32_t, 1000> myvec8;
 typedef LockfreeVector9<uint32_t, 1000, 0, 16> myvec9;
-typedef LockfreeMap<int32_t, 0, 50> mymap;
+typedef LockfreeVector9<uint32_t, 1000, 0, 16, UINT32_MAX> myvec9e;
+typedef LockfreeVector9<uint32_t, 1024, 0, 16, 0, 4> myvec9g;
+typedef LockfreeVector9<int32_t, 1024, 0, 16, 0, 4> myvec9r; // records
+typedef LockfreeVector10<uint32_t, 1000, 16> myvec10;
+typedef LockfreeMap<int32_t, 0> mymap;
 typedef LockfreeMap2<int32_t, 50, 0, 16, 2048> mymap2;
 typedef LockfreeMap3<int32_t, 50, 0, 16> mymap3;
+typedef LockfreeHashMap<int32_t, 50, 0, 16> myhashmap;
 typedef tbb::concurrent_vector<uint32_t> tbbvec;
 
+// 16 bytes without a spare value, check is derived from key so torn copies are detected
+struct Wide {
+    uint64_t key;
+    uint64_t check;
+
+    inline bool operator == (const Wide& other) const { return key == other.key && check == other.check; }
+};
+typedef LockfreeVector10<Wide, 1000, 16> myvec10w;
+
 
 template<class T>
-void read(T& arr, std::vector<unsigned int>& test, unsigned int consumer_id) {
+void read(T& arr, std::vector<unsigned int>& test, unsigned int) {
     for (auto it = arr.iter(); !it.done(); ++it) test[*it]++;
 }
-template<> void read<myvec6>(myvec6& arr, std::vector<unsigned int>& test, unsigned int consumer_id) {
-    for (auto it = arr.iter(consumer_id); !it.done(); ++it) test[*it]++;
+template<> void read<myvec7>(myvec7& arr, std::vector<unsigned int>& test, unsigned int) {
+    for (uint32_t lit : arr) if (lit > 0 && lit < test.size()) test[lit]++; else std::cout << lit << " ";
+}
+template<> void read<myvec8>(myvec8& arr, std::vector<unsigned int>& test, unsigned int) {
+    for (uint32_t lit : arr) if (lit > 0 && lit < test.size()) test[lit]++; else std::cout << lit << " ";
+}
+template<> void read<myvec9>(myvec9& arr, std::vector<unsigned int>& test, unsigned int) {
+    for (uint32_t lit : arr) if (lit > 0 && lit < test.size()) test[lit]++; else std::cout << lit << " ";
 }
-template<> void read<myvec7>(myvec7& arr, std::vector<unsigned int>& test, unsigned int consumer_id) {
+template<> void read<myvec9e>(myvec9e& arr, std::vector<unsigned int>& test, unsigned int) {
     for (uint32_t lit : arr) if (lit > 0 && lit < test.size()) test[lit]++; else std::cout << lit << " ";
 }
-template<> void read<myvec8>(myvec8& arr, std::vector<unsigned int>& test, unsigned int consumer_id) {
+template<> void read<myvec9g>(myvec9g& arr, std::vector<unsigned int>& test, unsigned int) {
     for (uint32_t lit : arr) if (lit > 0 && lit < test.size()) test[lit]++; else std::cout << lit << " ";
 }
-template<> void read<myvec9>(myvec9& arr, std::vector<unsigned int>& test, unsigned int consumer_id) {
+template<> void read<myvec9r>(myvec9r& arr, std::vector<unsigned int>& test, unsigned int) {
+    for (auto record : arr.records()) {
+        for (int32_t lit : record) if (lit == record[0] && lit > 0 && (size_t)lit < test.size()) test[lit]++; else std::cout << lit << " ";
+    }
+}
+template<> void read<myvec10>(myvec10& arr, std::vector<unsigned int>& test, unsigned int) {
     for (uint32_t lit : arr) if (lit > 0 && lit < test.size()) test[lit]++; else std::cout << lit << " ";
 }
-template<> void read<mymap>(mymap& map, std::vector<unsigned int>& test, unsigned int consumer_id) {
-    for (int i = 0; i < map.size(); i++) {
-        for (auto it = map.iter(i, consumer_id); !it.done(); ++it) test[*it]++;
+template<> void read<mymap>(mymap& map, std::vector<unsigned int>& test, unsigned int) {
+    for (unsigned int i = 0; i < map.size(); i++) {
+        for (auto it = map.iter(i); !it.done(); ++it) test[*it]++;
     }
 }
-template<> void read<mymap2>(mymap2& map, std::vector<unsigned int>& test, unsigned int consumer_id) {
-    for (int i = 0; i < map.size(); i++) {
-        for (auto lit : map[i]) if (lit > 0 && lit < test.size()) test[lit]++; else std::cout << lit << " ";
+template<> void read<mymap2>(mymap2& map, std::vector<unsigned int>& test, unsigned int) {
+    for (unsigned int i = 0; i < map.size(); i++) {
+        for (auto lit : map[i]) if (lit > 0 && (size_t)lit < test.size()) test[lit]++; else std::cout << lit << " ";
     }
 }
-template<> void read<mymap3>(mymap3& map, std::vector<unsigned int>& test, unsigned int consumer_id) {
-    for (int i = 0; i < map.size(); i++) {
-        for (auto lit : map[i]) if (lit > 0 && lit < test.size()) test[lit]++; else std::cout << lit << " ";
+template<> void read<mymap3>(mymap3& map, std::vector<unsigned int>& test, unsigned int) {
+    for (unsigned int i = 0; i < map.size(); i++) {
+        for (auto lit : map[i]) if (lit > 0 && (size_t)lit < test.size()) test[lit]++; else std::cout << lit << " ";
     }
 }
-template<> void read<tbbvec>(tbbvec& arr, std::vector<unsigned int>& test, unsigned int consumer_id) {
+template<> void read<myhashmap>(myhashmap& map, std::vector<unsigned int>& test, unsigned int) {
+    for (unsigned int id = 0; id < map.size(); id++) {
+        for (auto lit : map.at(id)) if (lit > 0 && (size_t)lit < test.size()) test[lit]++; else std::cout << lit << " ";
+    }
+}
+template<> void read<tbbvec>(tbbvec& arr, std::vector<unsigned int>& test, unsigned int) {
     for (uint32_t lit : arr) test[lit]++;
 }
 
@@ -101,6 +134,58 @@ void producer<mymap3>(mymap3& map, uint32_t num, uint32_t amount) {
     }
 }
 
+template<>
+void producer<myhashmap>(myhashmap& map, uint32_t num, uint32_t amount) { 
+    for (unsigned int i = 0; i < amount; i++) {
+        map.push((i % num) * 0x9E3779B97F4A7C15ull, num); // sparse keys
+    }
+}
+
+// every thread adds its number once to each key, the repetition has to be rejected
+void unique_producer(mymap3& map, uint32_t num, uint32_t amount) { 
+    for (unsigned int i = 0; i < amount; i++) {
+        map.push_unique(i, num);
+        if (map.push_unique(i, num)) std::cout << "duplicate " << num << " ";
+    }
+}
+
+// records of up to 7 elements, each filled with num
+template<>
+void producer<myvec9r>(myvec9r& arr, uint32_t num, uint32_t amount) { 
+    int32_t record[7];
+    std::fill(record, record + 7, (int32_t)num);
+    for (unsigned int i = 0; i < amount; ) {
+        unsigned int n = std::min(amount - i, 1 + (i + num) % 7);
+        arr.append_record(record, n);
+        i += n;
+    }
+}
+
+template<class T>
+void batch_producer(T& arr, uint32_t num, uint32_t amount) { 
+    std::vector<uint32_t> batch(64, num);
+    for (unsigned int i = 0; i < amount; i += batch.size()) {
+        arr.push(batch.begin(), batch.begin() + std::min<size_t>(batch.size(), amount - i));
+    }
+}
+
+template<>
+void batch_producer<mymap3>(mymap3& map, uint32_t num, uint32_t amount) { 
+    std::vector<uint32_t> batch(64, num);
+    for (unsigned int i = 0; i < amount; i += batch.size()) {
+        map[(i / batch.size()) % num].push(batch.begin(), batch.begin() + std::min<size_t>(batch.size(), amount - i));
+    }
+}
+
+template<class T>
+void buffered_producer(T& map, uint32_t num, uint32_t amount) { 
+    LockfreeWriteBuffer<T, int32_t> buffer(map, 64);
+    for (unsigned int i = 0; i < amount; i++) {
+        buffer.push(i % num, num);
+    }
+    buffer.flush();
+}
+
 template<class T>
 void consumer(T& arr, unsigned int consumer_id, size_t max_threads, size_t max_numbers) {
     std::vector<unsigned int> test { };
@@ -113,8 +198,32 @@ void consumer(T& arr, unsigned int consumer_id, size_t max_threads, size_t max_n
     }
 }
 
+// resumes from where the last poll stopped instead of re-reading from begin()
+template<class T>
+void tailing_consumer(T& arr, unsigned int, size_t max_threads, size_t max_numbers) {
+    typename T::cursor cursor;
+    size_t size = 0;
+    while (size < max_numbers * max_threads) {
+        size_t n = arr.poll(cursor, [] (uint32_t lit) { assert(lit > 0); });
+        if (n == 0) arr.wait_for_new(cursor, std::chrono::milliseconds(10)); // sleep instead of spinning
+        size += n;
+    }
+}
+
+template<>
+void tailing_consumer<mymap3>(mymap3& map, unsigned int, size_t max_threads, size_t max_numbers) {
+    std::vector<mymap3::cursor> cursors { };
+    size_t size = 0;
+    while (size < max_numbers * max_threads) {
+        cursors.resize(map.size());
+        for (unsigned int i = 0; i < cursors.size(); i++) {
+            size += map[i].poll(cursors[i], [] (int32_t lit) { assert(lit > 0); });
+        }
+    }
+}
+
 template<class T>
-void final_count(T& arr, unsigned int consumer_id, size_t max_threads, size_t max_numbers) {
+void final_count(T& arr, unsigned int consumer_id, size_t max_threads, size_t) {
     std::cout << "Done. Checking..." << std::endl;
     std::vector<unsigned int> test { };
     test.resize(max_threads+1);
@@ -125,14 +234,118 @@ void final_count(T& arr, unsigned int consumer_id, size_t max_threads, size_t ma
     }
 }
 
+// counts with the page scan kernels (see LockfreeScan) instead of the iterators
+template<class T>
+void scan_count(T& arr, size_t max_threads, size_t max_numbers) {
+    std::vector<uint32_t> out { };
+    size_t filtered = arr.filter(1, max_threads, out);
+    uint32_t first = 0;
+    bool found = arr.find_first([max_threads] (uint32_t lit) { return lit == max_threads; }, first);
+    for (size_t i = 1; i <= max_threads; i++) {
+        std::cout << "Counted " << arr.count(i) << " Entries of Thread " << i << std::endl;
+    }
+    std::cout << "Filtered " << filtered << " (expected " << max_threads * max_numbers << "), " 
+        << (found && arr.contains(max_threads) && !arr.contains(max_threads + 1) ? "" : "no ") << "membership" << std::endl;
+}
+template<>
+void scan_count<mymap3>(mymap3& map, size_t max_threads, size_t max_numbers) {
+    std::vector<int32_t> out { };
+    size_t filtered = 0;
+    for (unsigned int k = 0; k < map.size(); k++) filtered += map[k].filter(1, max_threads, out);
+    for (size_t i = 1; i <= max_threads; i++) {
+        size_t count = 0;
+        for (unsigned int k = 0; k < map.size(); k++) count += map[k].count(i);
+        std::cout << "Counted " << count << " Entries of Thread " << i << std::endl;
+    }
+    std::cout << "Filtered " << filtered << " (expected " << max_threads * max_numbers << "), " 
+        << (map[0].contains(max_threads) && !map[0].contains(max_threads + 1) ? "" : "no ") << "membership" << std::endl;
+}
+
+// counts with parallel_for_each() and sums with parallel_reduce()
 template<class T>
-void run_test(T& arr, uint32_t max_numbers, size_t max_readers, size_t max_writers) {
+void parallel_count(T& arr, size_t max_threads, size_t max_numbers) {
+    std::vector<std::atomic<unsigned int>> test(max_threads + 1);
+    arr.parallel_for_each([&test] (uint32_t lit) { if (lit < test.size()) test[lit]++; });
+    uint64_t sum = arr.parallel_reduce((uint64_t)0, [] (uint64_t acc, uint32_t lit) { return acc + lit; }, std::plus<uint64_t>());
+    for (size_t i = 1; i <= max_threads; i++) {
+        std::cout << "Counted " << test[i] << " Entries of Thread " << i << std::endl;
+    }
+    std::cout << "Sum " << sum << " (expected " << max_numbers * max_threads * (max_threads + 1) / 2 << ")" << std::endl;
+}
+template<>
+void parallel_count<mymap3>(mymap3& map, size_t max_threads, size_t max_numbers) {
+    std::vector<std::atomic<unsigned int>> test(max_threads + 1);
+    map.parallel_for_each([&test] (int32_t, int32_t lit) { if (lit > 0 && (size_t)lit < test.size()) test[lit]++; });
+    uint64_t sum = map.parallel_reduce((uint64_t)0, [] (uint64_t acc, int32_t, int32_t lit) { return acc + lit; }, std::plus<uint64_t>());
+    for (size_t i = 1; i <= max_threads; i++) {
+        std::cout << "Counted " << test[i] << " Entries of Thread " << i << std::endl;
+    }
+    std::cout << "Sum " << sum << " (expected " << max_numbers * max_threads * (max_threads + 1) / 2 << ")" << std::endl;
+}
+
+// contention and retry counters, zeros unless compiled with -DLOCKFREE_STATS
+template<class T>
+void print_stats(T& arr) {
+    LockfreeStats::Snapshot stats = arr.statistics().snapshot();
+    std::cout << "Stats";
+    for (unsigned int c = 0; c < LockfreeStats::COUNTERS; c++) {
+        std::cout << " " << LockfreeStats::names[c] << "=" << stats.counts[c];
+    }
+    std::cout << std::endl;
+}
+
+// pages a list of n elements holds beyond its first page of first elements
+inline size_t extra_pages(size_t n, size_t first, size_t N) {
+    return n > first ? (n - first + N - 1) / N : 0;
+}
+
+// every page beyond the first is taken by exactly one page switch (needs -DLOCKFREE_STATS, see make stats)
+template<class T>
+void check_page_switches(T& arr, size_t expected) {
+    print_stats<>(arr);
+#ifdef LOCKFREE_STATS
+    uint64_t switches = arr.statistics().snapshot()[LockfreeStats::PAGE_SWITCHES];
+    std::cout << "Page switches " << switches << " (expected " << expected << ")" << std::endl;
+#else
+    (void)expected;
+    std::cout << "Page switches not counted, build with -DLOCKFREE_STATS" << std::endl;
+#endif
+}
+
+template<class T>
+void check_random_access(T& arr, size_t expected) {
+    size_t size = arr.size();
+    size_t mismatch = 0;
+    for (size_t i = 0; i < size; i += 997) {
+        auto it = arr.seek(i);
+        if (it == arr.end() || *it != arr[i]) mismatch++;
+    }
+    std::cout << "Size " << size << " (expected " << expected << "), " << mismatch << " seek mismatches" << std::endl;
+}
+
+// copies and seeks compare equal to the iterator at the same slot, expects no tombstones
+template<class T>
+void check_iterator_equality(T& arr) {
+    size_t mismatch = (arr.seek(0) == arr.begin()) ? 0 : 1;
+    size_t i = 0;
+    for (auto it = arr.begin(); it != arr.end(); ++it, ++i) {
+        auto copy = it;
+        if (copy != it || !(copy == it)) mismatch++;
+        if (i % 97 == 0 && (arr.seek(i) != it || arr[i] != *it)) mismatch++;
+        if (++copy == it) mismatch++;
+    }
+    std::cout << "Iterated " << i << ", " << mismatch << " iterator mismatches" << std::endl;
+}
+
+template<class T>
+void run_test(T& arr, uint32_t max_numbers, size_t max_readers, size_t max_writers, void (*produce)(T&, uint32_t, uint32_t) = producer<T>, 
+        void (*consume)(T&, unsigned int, size_t, size_t) = consumer<T>) {
     std::vector<std::thread> threads { };
     for (uint32_t n = 0; n < max_writers; n++) {
-        threads.push_back(std::thread(producer<T>, std::ref(arr), n+1, max_numbers));
+        threads.push_back(std::thread(produce, std::ref(arr), n+1, max_numbers));
     }
     for (uint32_t n = 0; n < max_readers; n++) {
-        threads.push_back(std::thread(consumer<T>, std::ref(arr), n, max_writers, max_numbers));
+        threads.push_back(std::thread(consume, std::ref(arr), n, max_writers, max_numbers));
     }
     for (std::thread& thread : threads) {
         thread.join();
@@ -140,9 +353,349 @@ void run_test(T& arr, uint32_t max_numbers, size_t max_readers, size_t max_write
     final_count<T>(std::ref(arr), 0, max_writers, max_numbers);
 }
 
+/**
+ * Writers push increasing values to a few keys while one thread clears the keys and guarded readers iterate them. 
+ * Values encode writer and sequence number, so readers can check that every list they see holds values of its key 
+ * in push order. Further readers access elements below size() by seek() and operator[], which see S or end() if 
+ * the list was cleared since. Afterwards each writer's values in each list must be a gapless suffix of what it pushed there.
+ * */
+template<class T>
+void clearing_test(T& map, uint32_t max_numbers, size_t max_readers, size_t max_writers) {
+    const unsigned int keys = 4;
+    std::atomic<bool> done { false };
+    std::atomic<size_t> clears { 0 }, disorders { 0 };
+    std::vector<std::thread> writers { }, others { };
+    for (uint32_t w = 1; w <= max_writers; w++) {
+        writers.push_back(std::thread([&map, w, max_numbers] {
+            for (uint32_t j = 0; j < max_numbers; j++) map.push(j % keys, (int32_t)((w << 24) | (j + 1)));
+        }));
+    }
+    for (size_t r = 0; r < max_readers; r++) {
+        others.push_back(std::thread([&map, &done, &disorders, max_writers] {
+            while (!done.load()) {
+                auto guard = map.protect();
+                for (unsigned int k = 0; k < keys; k++) {
+                    std::vector<uint32_t> last(max_writers + 1, 0);
+                    for (int32_t lit : map[k]) {
+                        uint32_t w = (uint32_t)lit >> 24, j = (uint32_t)lit & 0xFFFFFF;
+                        if (w == 0 || w > max_writers || (j - 1) % keys != k || j <= last[w]) disorders++;
+                        else last[w] = j;
+                    }
+                }
+            }
+        }));
+        others.push_back(std::thread([&map, &done, &disorders, max_writers] {
+            auto foreign = [max_writers] (int32_t lit, unsigned int k) {
+                uint32_t w = (uint32_t)lit >> 24, j = (uint32_t)lit & 0xFFFFFF;
+                return lit != 0 && (w == 0 || w > max_writers || (j - 1) % keys != k);
+            };
+            while (!done.load()) {
+                auto guard = map.protect();
+                for (unsigned int i = 0; i < 1024; i++) {
+                    unsigned int k = i % keys;
+                    size_t n = map[k].size();
+                    if (n == 0) continue;
+                    auto it = map[k].seek(n - 1 - i % n);
+                    if (it != map[k].end() && foreign(*it, k)) disorders++;
+                    if (foreign(map[k][n - 1 - (i / keys) % n], k)) disorders++;
+                }
+            }
+        }));
+    }
+    others.push_back(std::thread([&map, &done, &clears] {
+        for (unsigned int k = 0; !done.load(); k++) {
+            map.clear(k % keys);
+            clears++;
+            std::this_thread::yield();
+        }
+    }));
+    for (std::thread& thread : writers) thread.join();
+    done = true;
+    for (std::thread& thread : others) thread.join();
+
+    size_t survivors = 0, gaps = 0;
+    for (unsigned int k = 0; k < keys; k++) {
+        std::vector<std::vector<uint32_t>> seen(max_writers + 1);
+        for (int32_t lit : map[k]) {
+            uint32_t w = (uint32_t)lit >> 24;
+            if (w == 0 || w > max_writers) gaps++;
+            else seen[w].push_back(((uint32_t)lit & 0xFFFFFF) - 1);
+        }
+        uint32_t final = (max_numbers - 1) - ((max_numbers - 1 + keys - k) % keys); // last sequence number pushed to k
+        for (uint32_t w = 1; w <= max_writers; w++) {
+            survivors += seen[w].size();
+            for (size_t i = 1; i < seen[w].size(); i++) gaps += (seen[w][i] != seen[w][i-1] + keys);
+            if (!seen[w].empty() && seen[w].back() != final) gaps++;
+        }
+    }
+    std::cout << "Cleared " << clears << " times, " << survivors << " survivors, " << gaps << " gaps, " << disorders << " disorders" << std::endl;
+}
+
+/**
+ * A reader holds a guard on a cleared list while its pages could be reused by pushes to other keys, 
+ * then the keys are filled and cleared in cycles while guarded readers check that every value they 
+ * see by iteration, seek() or operator[] belongs to the key they access. Values encode cycle and key. Recycled pages must be reused, 
+ * so the reserved pages stay bounded, and the final fill must be seen without stale values.
+ * */
+template<class T>
+void recycling_test(T& map, uint32_t max_numbers, size_t max_readers, size_t max_writers) {
+    const unsigned int keys = map.size(), cycles = 8;
+    auto value = [] (unsigned int cycle, unsigned int key) { return (int32_t)(((cycle + 1) << 16) | (key + 1)); };
+    size_t early = 0, stale = 0, late = 0;
+    {   // grace period
+        for (uint32_t j = 0; j < max_numbers / 10; j++) map.push(0, value(0, 0));
+        auto guard = map.protect();
+        auto begin = map[0].begin(), end = map[0].end();
+        map.clear(0);
+        for (unsigned int i = 0; i < 64; i++) { auto other = map.protect(); } // collect
+        early = map.recycled_pages();
+        for (uint32_t j = 0; j < max_numbers / 10; j++) map.push(keys - 1, value(1, keys - 1));
+        size_t n = 0;
+        for (auto it = begin; it != end; ++it, ++n) stale += (*it != value(0, 0));
+        stale += (n != max_numbers / 10);
+    }
+    for (unsigned int i = 0; i < 64; i++) { auto other = map.protect(); } // collect
+    if (map.recycled_pages() == 0) late++;
+    map.clear(keys - 1);
+
+    std::atomic<bool> done { false };
+    std::atomic<size_t> foreign { 0 };
+    std::vector<std::thread> readers { };
+    for (size_t r = 0; r < max_readers; r++) {
+        readers.push_back(std::thread([&map, &done, &foreign, keys, cycles] {
+            while (!done.load()) {
+                auto guard = map.protect();
+                for (unsigned int k = 0; k < keys; k++) {
+                    for (int32_t lit : map[k]) foreign += ((lit & 0xFFFF) != (int32_t)k + 1 || (lit >> 16) > (int32_t)cycles);
+                }
+            }
+        }));
+        readers.push_back(std::thread([&map, &done, &foreign, keys, cycles] {
+            auto wrong = [cycles] (int32_t lit, unsigned int k) { // S if cleared since size()
+                return lit != 0 && ((lit & 0xFFFF) != (int32_t)k + 1 || (lit >> 16) > (int32_t)cycles);
+            };
+            while (!done.load()) {
+                auto guard = map.protect();
+                for (unsigned int i = 0; i < 1024; i++) {
+                    unsigned int k = i % keys;
+                    size_t n = map[k].size();
+                    if (n == 0) continue;
+                    auto it = map[k].seek(n - 1 - i % n);
+                    if (it != map[k].end() && wrong(*it, k)) foreign++;
+                    if (wrong(map[k][n - 1 - (i / keys) % n], k)) foreign++;
+                }
+            }
+        }));
+    }
+    size_t first = 0;
+    uint32_t per_cycle = max_numbers / cycles;
+    for (unsigned int c = 0; c < cycles; c++) {
+        std::vector<std::thread> writers { };
+        for (size_t w = 0; w < max_writers; w++) {
+            writers.push_back(std::thread([&map, &value, c, keys, per_cycle] {
+                for (uint32_t j = 0; j < per_cycle; j++) map.push(j % keys, value(c, j % keys));
+            }));
+        }
+        for (std::thread& thread : writers) thread.join();
+        if (c == 0) first = map.reserved_pages();
+        if (c + 1 == cycles) break;
+        for (unsigned int k = 0; k < keys; k++) map.clear(k);
+        for (unsigned int i = 0; i < 1000 && map.recycled_pages() == 0; i++) { // wait for readers to leave
+            auto other = map.protect();
+            std::this_thread::yield();
+        }
+    }
+    done = true;
+    for (std::thread& thread : readers) thread.join();
+
+    for (unsigned int k = 0; k < keys; k++) {
+        size_t n = 0;
+        for (int32_t lit : map[k]) stale += (lit != value(cycles - 1, k)), n++;
+        size_t expected = 0;
+        for (uint32_t j = 0; j < per_cycle; j++) expected += (j % keys == k);
+        stale += (n != expected * max_writers);
+    }
+    std::cout << "Reserved " << first << " pages after the first cycle, " << map.reserved_pages() << " after the last, " 
+        << early << " pages recycled early, " << late << " late, " << stale << " stale, " << foreign << " foreign" << std::endl;
+}
+
+/**
+ * Persistent writers push to a fresh map per round, which is destroyed after the round, so their 
+ * thread-local magazines outlive the maps (more than they cache) and fresh maps may reuse addresses. 
+ * Each round and a map that lives across all rounds must hold exactly the values pushed to them.
+ * */
+template<class T>
+void magazine_test(uint32_t max_numbers, size_t max_writers) {
+    const unsigned int rounds = 12;
+    T keep(1);
+    std::atomic<T*> current { nullptr };
+    std::atomic<unsigned int> round { 0 };
+    std::atomic<size_t> finished { 0 };
+    uint32_t per_round = max_numbers / rounds;
+    std::vector<std::thread> writers { };
+    for (size_t w = 0; w < max_writers; w++) {
+        writers.push_back(std::thread([&keep, &current, &round, &finished, w, per_round, rounds] {
+            for (unsigned int r = 1; r <= rounds; r++) {
+                while (round.load() < r) std::this_thread::yield();
+                T* map = current.load();
+                for (uint32_t j = 0; j < per_round; j++) map->push(j % 2, (int32_t)(r << 16 | w));
+                keep.push(0, (int32_t)(r << 16 | w));
+                finished++;
+            }
+        }));
+    }
+    size_t errors = 0;
+    for (unsigned int r = 1; r <= rounds; r++) {
+        T* map = new T(2);
+        current = map;
+        round = r;
+        while (finished.load() < r * max_writers) std::this_thread::yield();
+        size_t n = 0;
+        for (unsigned int k = 0; k < 2; k++) {
+            for (int32_t lit : (*map)[k]) errors += ((uint32_t)lit >> 16 != r), n++;
+        }
+        errors += (n != per_round * max_writers);
+        delete map;
+    }
+    for (std::thread& thread : writers) thread.join();
+    size_t n = 0;
+    for (int32_t lit : keep[0]) errors += ((uint32_t)lit >> 16 == 0 || (uint32_t)lit >> 16 > rounds), n++;
+    errors += (n != rounds * max_writers);
+    std::cout << "Destroyed " << rounds << " maps, " << errors << " errors" << std::endl;
+}
+
+/**
+ * Lists shorter than, as long as and longer than the inline page of the key header, filled by single and bulk pushes. 
+ * Iteration and random access have to cross the boundary between inline page and pages in order, 
+ * cleared lists (inline or not) have to be empty and hold only the values pushed afterwards.
+ * */
+template<class T>
+void inline_test(T& map) {
+    const unsigned int I = T::I, N = 50;
+    const std::vector<unsigned int> lengths { 0, 1, I - 1, I, I + 1, I + N - 1, I + N, I + N + 1, I + 3 * N + 2 };
+    auto check = [&map] (unsigned int key, unsigned int n, int32_t base) {
+        size_t errors = (map[key].size() != n);
+        unsigned int i = 0;
+        for (int32_t lit : map[key]) errors += (lit != base + (int32_t)i++);
+        errors += (i != n);
+        for (i = 0; i < n && i < map[key].size(); i++) errors += (map[key][i] != base + (int32_t)i);
+        return errors;
+    };
+    size_t errors = 0;
+    for (unsigned int k = 0; k < lengths.size(); k++) {
+        for (unsigned int j = 0; j < lengths[k]; j++) map.push(2 * k, (int32_t)(j + 1));
+        std::vector<int32_t> values(lengths[k]);
+        std::iota(values.begin(), values.end(), 1);
+        map.push(2 * k + 1, values.begin(), values.end());
+        errors += check(2 * k, lengths[k], 1) + check(2 * k + 1, lengths[k], 1);
+    }
+    for (unsigned int k = 0; k < 2 * lengths.size(); k++) {
+        map.clear(k);
+        errors += check(k, 0, 1);
+    }
+    for (unsigned int i = 0; i < 64; i++) { auto guard = map.protect(); } // collect, inline pages become reusable
+    for (unsigned int k = 0; k < lengths.size(); k++) {
+        for (unsigned int j = 0; j < lengths[k]; j++) map.push(2 * k, (int32_t)(j + 1001));
+        errors += check(2 * k, lengths[k], 1001) + check(2 * k + 1, 0, 1);
+        map.clear(2 * k); // a second clear of a list that is still inline
+        errors += check(2 * k, 0, 1);
+    }
+    std::cout << "Inline page of " << I << " elements, " << errors << " errors" << std::endl;
+}
+
+/**
+ * Values that the other vectors reserve (0, UINT32_MAX) or that span several words are stored 
+ * by LockfreeVector10 like any other. Writer w pushes value(w, j), readers iterate and access slots 
+ * at random while the writers run, every value has to fall into a bucket (bucket(v) < expected.size()). 
+ * Afterwards the counts per bucket, the size and seek() against operator [] are checked.
+ * */
+template<class T, class Value, class Bucket>
+void value_test(uint32_t max_numbers, size_t max_readers, size_t max_writers, Value value, Bucket bucket, const std::vector<size_t>& expected) {
+    T arr{};
+    std::atomic<bool> done { false };
+    std::atomic<size_t> invalid { 0 };
+    std::vector<std::thread> writers { }, readers { };
+    for (size_t w = 0; w < max_writers; w++) {
+        writers.push_back(std::thread([&arr, &value, w, max_numbers] {
+            for (uint32_t j = 0; j < max_numbers; j++) arr.push(value(w, j));
+        }));
+    }
+    for (size_t r = 0; r < max_readers; r++) {
+        readers.push_back(std::thread([&arr, &bucket, &expected, &done, &invalid, r] {
+            size_t i = r;
+            do {
+                for (auto v : arr) invalid += (bucket(v) >= expected.size());
+                for (size_t n = arr.size(), k = 0; n > 0 && k < 1024; k++, i = i * 6364136223846793005ull + 1) {
+                    if (arr.ready(i % n)) invalid += (bucket(arr[i % n]) >= expected.size());
+                }
+            } while (!done.load());
+        }));
+    }
+    for (std::thread& thread : writers) thread.join();
+    done = true;
+    for (std::thread& thread : readers) thread.join();
+    std::vector<size_t> counts(expected.size() + 1);
+    for (auto v : arr) counts[std::min(bucket(v), expected.size())]++;
+    size_t wrong = counts.back();
+    for (size_t b = 0; b < expected.size(); b++) wrong += (counts[b] != expected[b]);
+    size_t size = arr.size(), mismatch = 0;
+    for (size_t i = 0; i < size; i += 997) {
+        auto it = arr.seek(i);
+        if (!arr.ready(i) || it == arr.end() || !(*it == arr[i]) || bucket(arr[i]) >= expected.size()) mismatch++;
+    }
+    std::cout << "Size " << size << " (expected " << max_numbers * max_writers << "), " << invalid << " invalid reads, " 
+        << wrong << " wrong counts, " << mismatch << " seek mismatches" << std::endl;
+}
+
+// tested structure and checks per mode, -1 is a sequential std::vector
+static const char* modes[] = {
+    "tbb::concurrent_vector", 
+    "LockfreeVector", 
+    "LockfreeVector2", 
+    "LockfreeVector3", 
+    "LockfreeVector4", 
+    "LockfreeVector5", 
+    "LockfreeVector6", 
+    "LockfreeVector7", 
+    "LockfreeVector8", 
+    "LockfreeVector9, random access", 
+    "LockfreeMap", 
+    "LockfreeMap2", 
+    "LockfreeMap3", 
+    "LockfreeVector9, batch pushes, random access", 
+    "LockfreeMap3, batch pushes", 
+    "LockfreeMap2, buffered pushes (LockfreeWriteBuffer)", 
+    "LockfreeMap3, buffered pushes (LockfreeWriteBuffer)", 
+    "LockfreeVector10, random access", 
+    "LockfreeVector10, batch pushes, random access", 
+    "LockfreeVector9, erase and compact", 
+    "LockfreeVector9 with growing pages, batch pushes, random access", 
+    "LockfreeMap3, keys added while running", 
+    "LockfreeHashMap, statistics", 
+    "LockfreeVector9, tailing consumers (poll)", 
+    "LockfreeMap3, tailing consumers (poll)", 
+    "LockfreeMap3, push_unique", 
+    "LockfreeVector9, records", 
+    "LockfreeVector9, compress, random access, iterator equality", 
+    "LockfreeVector9, scan kernels", 
+    "LockfreeMap3, scan kernels", 
+    "LockfreeVector9 with growing pages, parallel_for_each and parallel_reduce", 
+    "LockfreeMap3, parallel_for_each and parallel_reduce", 
+    "LockfreeVector9, statistics", 
+    "LockfreeMap2, statistics", 
+    "LockfreeMap3, clear against pushes and guarded readers", 
+    "LockfreeMap2, page recycling after clear", 
+    "LockfreeMap2, thread-local magazines of destroyed maps", 
+    "LockfreeMap2 and LockfreeMap3, inline pages", 
+    "LockfreeVector10, 16-byte struct values, random access", 
+    "LockfreeVector10, values 0 and UINT32_MAX, random access", 
+};
+
 int main(int argc, char** argv) {
     if (argc < 4) {
-        std::cout << "Usage: " << argv[0] << " [n_numbers] [n_readers] [n_writers]" << std::endl;
+        std::cout << "Usage: " << argv[0] << " [n_numbers] [n_readers] [n_writers] [mode]" << std::endl;
+        std::cout << "Modes:" << std::endl << "  -1: std::vector, sequential" << std::endl;
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) std::cout << "  " << m << ": " << modes[m] << std::endl;
         return 0;
     }
 
@@ -164,10 +717,11 @@ int main(int argc, char** argv) {
         }
         for (uint32_t n = 0; n < max_readers; n++) {
             std::vector<unsigned int> test { };
-            test.resize(max_readers+1);
+            test.resize(max_writers+1);
             for (uint32_t n : arr) test[n]++;
         }
-    } if (mode == 0) { 
+    } 
+    else if (mode == 0) { 
         tbbvec arr(1000);
         run_test<>(arr, max_numbers, max_readers, max_writers);
     }
@@ -206,6 +760,7 @@ int main(int argc, char** argv) {
     else if (mode == 9) {
         myvec9 arr{}; 
         run_test<>(arr, max_numbers, max_readers, max_writers);
+        check_random_access(arr, max_numbers * max_writers);
     }
     else if (mode == 10) {
         mymap arr(max_writers, 1000); 
@@ -219,9 +774,157 @@ int main(int argc, char** argv) {
         mymap3 arr(max_writers); 
         run_test<>(arr, max_numbers, max_readers, max_writers);
     }
+    else if (mode == 13) {
+        myvec9 arr{}; 
+        run_test<>(arr, max_numbers, max_readers, max_writers, batch_producer<myvec9>);
+        check_random_access(arr, max_numbers * max_writers);
+    }
+    else if (mode == 14) {
+        mymap3 arr(max_writers); 
+        run_test<>(arr, max_numbers, max_readers, max_writers, batch_producer<mymap3>);
+    }
+    else if (mode == 15) {
+        mymap2 arr(max_writers); 
+        run_test<>(arr, max_numbers, max_readers, max_writers, buffered_producer<mymap2>);
+    }
+    else if (mode == 16) {
+        mymap3 arr(max_writers); 
+        run_test<>(arr, max_numbers, max_readers, max_writers, buffered_producer<mymap3>);
+    }
+    else if (mode == 17) {
+        myvec10 arr{}; 
+        run_test<>(arr, max_numbers, max_readers, max_writers);
+        check_random_access(arr, max_numbers * max_writers);
+    }
+    else if (mode == 18) {
+        myvec10 arr{}; 
+        run_test<>(arr, max_numbers, max_readers, max_writers, batch_producer<myvec10>);
+        check_random_access(arr, max_numbers * max_writers);
+    }
+    else if (mode == 19) {
+        myvec9e arr{}; 
+        run_test<>(arr, max_numbers, max_readers, max_writers);
+        size_t erased = arr.erase_if([](uint32_t lit) { return lit == 1; });
+        size_t compacted = arr.compact();
+        std::cout << "Erased " << erased << " Entries of Thread 1, compacted " << compacted << " pages" << std::endl;
+        final_count<>(arr, 0, max_writers, max_numbers);
+    }
+    else if (mode == 20) {
+        myvec9g arr{}; 
+        run_test<>(arr, max_numbers, max_readers, max_writers, batch_producer<myvec9g>);
+        check_random_access(arr, max_numbers * max_writers);
+    }
+    else if (mode == 21) {
+        mymap3 arr(1); // keys are added while the test runs
+        run_test<>(arr, max_numbers, max_readers, max_writers);
+    }
+    else if (mode == 22) {
+        myhashmap arr(4); 
+        run_test<>(arr, max_numbers, max_readers, max_writers);
+        size_t pages = 0;
+        for (unsigned int id = 0; id < arr.size(); id++) pages += extra_pages(arr.at(id).size(), myhashmap::Map::I, 50);
+        check_page_switches<>(arr, pages);
+    }
+    else if (mode == 23) {
+        myvec9 arr{}; 
+        run_test<>(arr, max_numbers, max_readers, max_writers, producer<myvec9>, tailing_consumer<myvec9>);
+    }
+    else if (mode == 24) {
+        mymap3 arr(max_writers); 
+        run_test<>(arr, max_numbers, max_readers, max_writers, producer<mymap3>, tailing_consumer<mymap3>);
+    }
+    else if (mode == 25) {
+        mymap3 arr(1); 
+        run_test<>(arr, max_numbers, max_readers, max_writers, unique_producer);
+    }
+    else if (mode == 26) {
+        myvec9r arr{}; 
+        run_test<>(arr, max_numbers, max_readers, max_writers);
+    }
+    else if (mode == 27) {
+        myvec9 arr{}; 
+        run_test<>(arr, max_numbers, max_readers, max_writers);
+        size_t compressed = arr.compress();
+        std::cout << "Compressed " << compressed << " pages" << std::endl;
+        final_count<>(arr, 0, max_writers, max_numbers);
+        check_random_access<>(arr, max_numbers * max_writers);
+        check_iterator_equality<>(arr);
+    }
+    else if (mode == 28) {
+        myvec9 arr{}; 
+        run_test<>(arr, max_numbers, max_readers, max_writers);
+        scan_count<>(arr, max_writers, max_numbers);
+    }
+    else if (mode == 29) {
+        mymap3 arr(max_writers); 
+        run_test<>(arr, max_numbers, max_readers, max_writers);
+        scan_count<>(arr, max_writers, max_numbers);
+    }
+    else if (mode == 30) {
+        myvec9g arr{}; 
+        run_test<>(arr, max_numbers, max_readers, max_writers);
+        parallel_count<>(arr, max_writers, max_numbers);
+    }
+    else if (mode == 31) {
+        mymap3 arr(max_writers); 
+        run_test<>(arr, max_numbers, max_readers, max_writers);
+        parallel_count<>(arr, max_writers, max_numbers);
+    }
+    else if (mode == 32) {
+        myvec9 arr{}; 
+        run_test<>(arr, max_numbers, max_readers, max_writers);
+        check_page_switches<>(arr, extra_pages(arr.size(), 1000, 1000));
+    }
+    else if (mode == 33) {
+        mymap2 arr(max_writers); 
+        run_test<>(arr, max_numbers, max_readers, max_writers);
+        size_t pages = 0;
+        for (unsigned int k = 0; k < arr.size(); k++) pages += extra_pages(arr[k].size(), mymap2::I, 50);
+        check_page_switches<>(arr, pages);
+    }
+    else if (mode == 34) {
+        mymap3 arr(4); 
+        clearing_test<>(arr, max_numbers, max_readers, max_writers);
+    }
+    else if (mode == 35) {
+        mymap2 arr(4); 
+        recycling_test<>(arr, max_numbers, max_readers, max_writers);
+    }
+    else if (mode == 36) {
+        magazine_test<mymap2>(max_numbers, max_writers);
+    }
+    else if (mode == 37) {
+        mymap2 arr2(18); 
+        inline_test<>(arr2);
+        mymap3 arr3(18); 
+        inline_test<>(arr3);
+    }
+    else if (mode == 38) {
+        auto value = [] (size_t w, uint32_t j) { 
+            uint64_t key = (uint64_t)w << 32 | j;
+            return Wide { key, ~key * 0x9E3779B97F4A7C15ull };
+        };
+        auto bucket = [max_writers] (const Wide& v) { // the writer, max_writers if torn
+            return (v.check == ~v.key * 0x9E3779B97F4A7C15ull) ? std::min<size_t>(v.key >> 32, max_writers) : max_writers;
+        };
+        value_test<myvec10w>(max_numbers, max_readers, max_writers, value, bucket, std::vector<size_t>(max_writers, max_numbers));
+    }
+    else if (mode == 39) {
+        auto value = [] (size_t, uint32_t j) { return j % 2 ? UINT32_MAX : (uint32_t)0; };
+        auto bucket = [] (uint32_t v) { return v == 0 ? (size_t)0 : v == UINT32_MAX ? (size_t)1 : (size_t)2; };
+        value_test<myvec10>(max_numbers, max_readers, max_writers, value, bucket, 
+            { max_writers * (max_numbers - max_numbers / 2), max_writers * (max_numbers / 2) });
+    }
+    else {
+        std::cout << "Unknown mode " << mode << std::endl;
+        return 1;
+    }
 
     auto end = std::chrono::steady_clock::now();
     std::cout << "Time elapsed: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << " ms" << std::endl;
+#ifdef LOCKFREE_LATENCY
+    LockfreeLatency::report(std::cout);
+#endif
 
     return 0;
 }
\ No newline at end of file
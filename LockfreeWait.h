@@ -0,0 +1,162 @@
+/*************************************************************************************************
+LockfreeWait -- Copyright (c) 2020, Markus Iser, KIT - Karlsruhe Institute of Technology
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **************************************************************************************************/
+
+#ifndef Lockfree_Wait
+#define Lockfree_Wait
+
+#include <cstdint>
+#include <climits>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <time.h>
+#endif
+
+/**
+ * Parking lot for consumers that wait for new elements
+ * 
+ * Structures are mapped to one of a fixed number of buckets by their address. A bucket holds a 
+ * sequence number which waiters sleep on (futex on Linux, yielding elsewhere), its lowest bit is set 
+ * while waiters are parked. Producers call notify() after committing their elements, which only 
+ * loads the sequence number unless the bit is set. Then the first producer advances the sequence 
+ * (clearing the bit) and wakes the waiters, producers that follow skip the wake until a waiter parks again.
+ * Waiters set the bit before they check for new elements and producers commit before they check 
+ * the bit (both sequentially consistent), so either the waiter sees the new elements or the producer sees the waiter.
+ * 
+ * Structures with a waiter count of their own keep producers off the shared buckets: producers 
+ * load the count after their (release) commit and only notify if it is non-zero. The store-load 
+ * ordering this needs is paid by the waiters, which issue a process-wide barrier (membarrier on Linux) 
+ * after incrementing the count, elsewhere producers fall back to a fence.
+ * */
+class LockfreeWait {
+    struct alignas(64) Bucket {
+        std::atomic<uint32_t> seq; // lowest bit: waiters are parked
+    };
+
+    static constexpr unsigned int BUCKETS = 64;
+    static inline Bucket buckets[BUCKETS] { };
+
+    static inline Bucket& bucket(const void* addr) {
+        uintptr_t h = (uintptr_t)addr >> 6; // headers are cache line aligned
+        return buckets[(h ^ (h >> 6) ^ (h >> 12)) % BUCKETS];
+    }
+
+    // sleep until seq changes from s, a notification arrives or the timeout expires
+    static void park(std::atomic<uint32_t>& seq, uint32_t s, std::chrono::nanoseconds timeout) {
+#ifdef __linux__
+        static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word");
+        struct timespec ts;
+        ts.tv_sec = timeout.count() / 1000000000;
+        ts.tv_nsec = timeout.count() % 1000000000;
+        syscall(SYS_futex, (uint32_t*)&seq, FUTEX_WAIT_PRIVATE, s, &ts, nullptr, 0);
+#else
+        (void)timeout;
+        if (seq.load(std::memory_order_relaxed) == s) std::this_thread::yield();
+#endif
+    }
+
+    static void wake(std::atomic<uint32_t>& seq) {
+#ifdef __linux__
+        syscall(SYS_futex, (uint32_t*)&seq, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#else
+        (void)seq;
+#endif
+    }
+
+    static bool register_barrier() {
+#ifdef __linux__
+        return syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+#else
+        return false;
+#endif
+    }
+
+    // waiters can order the commits of all producers, which then only need a compiler barrier
+    static inline const bool asymmetric = register_barrier();
+
+    static inline void producer_barrier() {
+        if (asymmetric) std::atomic_signal_fence(std::memory_order_seq_cst);
+        else std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    static inline void waiter_barrier() {
+#ifdef __linux__
+        if (asymmetric) {
+            syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+            return;
+        }
+#endif
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+public:
+    // called by producers after the (sequentially consistent) commit of new elements of the structure at addr
+    static inline void notify(const void* addr) {
+        Bucket& b = bucket(addr);
+        uint32_t s = b.seq.load(std::memory_order_seq_cst);
+        if ((s & 1) && b.seq.compare_exchange_strong(s, s + 1, std::memory_order_acq_rel)) {
+            wake(b.seq);
+        }
+    }
+
+    // called by producers after the commit of new elements of the structure at addr, which counts its waiters
+    static inline void notify(const void* addr, const std::atomic<uint32_t>& waiters) {
+        producer_barrier();
+        if (waiters.load(std::memory_order_relaxed) == 0) return;
+        std::atomic_thread_fence(std::memory_order_seq_cst); // commit before the bucket check
+        notify(addr);
+    }
+
+    /**
+     * Wait until ready() returns true or the timeout expires, returns the last result of ready()
+     * Wakeups of other structures in the same bucket are spurious and lead to another check
+     * */
+    template<typename Ready>
+    static bool wait(const void* addr, Ready ready, std::chrono::nanoseconds timeout) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        Bucket& b = bucket(addr);
+        while (true) {
+            uint32_t s = b.seq.fetch_or(1, std::memory_order_seq_cst) | 1;
+            std::atomic_thread_fence(std::memory_order_seq_cst); // announce before checking
+            if (ready()) return true;
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline) return false;
+            park(b.seq, s, deadline - now);
+        }
+    }
+
+    // wait() for structures that count their waiters, see notify(addr, waiters)
+    template<typename Ready>
+    static bool wait(const void* addr, std::atomic<uint32_t>& waiters, Ready ready, std::chrono::nanoseconds timeout) {
+        waiters.fetch_add(1, std::memory_order_relaxed);
+        waiter_barrier(); // producers that missed the count have committed
+        bool result = wait(addr, ready, timeout);
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+        return result;
+    }
+
+};
+
+#endif
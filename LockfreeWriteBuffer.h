@@ -0,0 +1,84 @@
+/*************************************************************************************************
+LockfreeWriteBuffer -- Copyright (c) 2020, Markus Iser, KIT - Karlsruhe Institute of Technology
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT
+OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ **************************************************************************************************/
+
+#ifndef Lockfree_WriteBuffer
+#define Lockfree_WriteBuffer
+
+#include <cstdlib>
+#include <vector>
+
+/**
+ * Producer-side write-combining handle for LockfreeMap2 and LockfreeMap3
+ * Pushes are buffered per key and written with one batch push once a key holds F elements
+ * A handle is owned by a single producer thread, readers see buffered elements after flush()
+ * M is the map type, T is the content type of the map
+ * */
+template<class M, typename T = uint32_t>
+class LockfreeWriteBuffer {
+    M& map;
+    unsigned int F; // flush threshold
+
+    std::vector<std::vector<T>> buffers; // indexed by key
+    std::vector<T> dirty; // keys buffered since the last flush()
+    std::vector<bool> listed; // key is in dirty
+
+    LockfreeWriteBuffer(LockfreeWriteBuffer const&) = delete;
+    void operator=(LockfreeWriteBuffer const&) = delete;
+
+    inline void write(T key, std::vector<T>& buffer) {
+        map.push(key, buffer.begin(), buffer.end());
+        buffer.clear();
+    }
+
+public:
+    LockfreeWriteBuffer(M& map_, unsigned int F_ = 64) : map(map_), F(F_), buffers(), dirty(), listed() { }
+
+    ~LockfreeWriteBuffer() {
+        flush();
+    }
+
+    void push(T key, T value) {
+        if ((size_t)key >= buffers.size()) {
+            buffers.resize(key + 1);
+            listed.resize(key + 1, false);
+        }
+        if (!listed[key]) {
+            listed[key] = true;
+            dirty.push_back(key);
+        }
+        std::vector<T>& buffer = buffers[key];
+        buffer.push_back(value);
+        if (buffer.size() >= F) write(key, buffer); // key stays listed, flush() skips empty buffers
+    }
+
+    void flush(T key) {
+        if ((size_t)key < buffers.size() && !buffers[key].empty()) write(key, buffers[key]);
+    }
+
+    void flush() {
+        for (T key : dirty) {
+            if (!buffers[key].empty()) write(key, buffers[key]);
+            listed[key] = false;
+        }
+        dirty.clear();
+    }
+
+};
+
+#endif